@@ -27,5 +27,5 @@ int main() {
 
     LongNum x = calculate_pi((N_DIGITS + 2) * std::log2l(10));
 
-    std::cout << x.to_string().substr(0, 2 + N_DIGITS) << std::endl;
+    std::cout << x.to_string(10, N_DIGITS, LongNum::Rounding::TOWARD_ZERO) << std::endl;
 }
\ No newline at end of file
@@ -1,25 +1,1340 @@
 #include "longnum.hpp"
 #include <cassert>
+#include <cerrno>
 #include <cmath>
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-inline void add_limbs(uint32_t& lhs, uint32_t rhs, int& carry) {
-    uint64_t result = (uint64_t)lhs + rhs + carry;
+// the NTT and Montgomery code uses this name only, __extension__ keeps -pedantic quiet about __int128
+__extension__ typedef unsigned __int128 uint128_t;
+// holds a product of two limbs
+typedef uint128_t dlimb_t;
+
+inline void add_limbs(limb_t& lhs, limb_t rhs, int& carry) {
+    dlimb_t result = (dlimb_t)lhs + rhs + carry;
     lhs = result;
-    carry = result >> 32;
+    carry = result >> LIMB_BITS;
 }
 
-inline void sub_limbs(uint32_t& lhs, uint32_t rhs, int& carry) {
+inline void sub_limbs(limb_t& lhs, limb_t rhs, int& carry) {
     int new_carry = lhs < rhs || (lhs <= rhs && carry);
     lhs -= rhs;
     lhs -= carry;
     carry = new_carry;
 }
 
-LongNum::LongNum(int _sign, unsigned int _binary_point, std::vector<uint32_t> _limbs) : sign(_sign), binary_point(_binary_point), limbs(std::move(_limbs))  {
+// below this many limbs in the shorter operand schoolbook multiplication wins
+const std::size_t KARATSUBA_THRESHOLD = 32;
+// below this many limbs Karatsuba wins over Toom-3
+const std::size_t TOOM3_THRESHOLD = 160;
+// below this many limbs in the shorter operand the number-theoretic transform never wins, above ntt_wins decides
+const std::size_t NTT_THRESHOLD = 1000;
+// limbs computed below the discarded part of a truncated product
+const std::size_t SHORT_PRODUCT_GUARD = 3;
+// splitting a truncated n x n product pays off when it skips the columns below this fraction of n
+const std::size_t SHORT_PRODUCT_NUM = 9, SHORT_PRODUCT_DEN = 10;
+// percentage of the needed columns that a truncated product leaves to its two smaller halves
+const std::size_t SHORT_PRODUCT_SPLIT = 30;
+// from this many limbs in both the divisor and the quotient division goes through a Newton reciprocal
+const std::size_t DIV_NEWTON_THRESHOLD = 500;
+// below this many limbs reciprocals are computed by long division, at least 3 for the recursion to shrink
+const std::size_t RECIPROCAL_THRESHOLD = 150;
+// from this many limbs radix conversion splits numbers at powers of the base instead of peeling off limbs of digits
+const std::size_t RADIX_DC_THRESHOLD = 100;
+// from this many limbs in the divisor a LongNumDivisor keeps a reciprocal, which pays off
+// for quotients of at least a quarter of that
+const std::size_t PREINV_THRESHOLD = 300;
+// largest piece of text print hands out at once
+const std::size_t PRINT_CHUNK = 1 << 16;
+
+// low-level kernels over little-endian limb arrays
+// sizes are passed explicitly, results may alias inputs only where noted
+
+// r = a + b, all of size n, may alias; returns carry
+static limb_t add_n(limb_t* r, const limb_t* a, const limb_t* b, std::size_t n) {
+    int carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        limb_t bi = b[i];
+        r[i] = a[i];
+        add_limbs(r[i], bi, carry);
+    }
+    return carry;
+}
+
+// r = a - b, all of size n, may alias; returns borrow
+static limb_t sub_n(limb_t* r, const limb_t* a, const limb_t* b, std::size_t n) {
+    int carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        limb_t bi = b[i];
+        r[i] = a[i];
+        sub_limbs(r[i], bi, carry);
+    }
+    return carry;
+}
+
+// r = a + b where an >= bn, r has an limbs; returns carry
+static limb_t add(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    int carry = add_n(r, a, b, bn);
+    for (std::size_t i = bn; i < an; i++) {
+        r[i] = a[i];
+        add_limbs(r[i], 0, carry);
+    }
+    return carry;
+}
+
+// r = a - b where an >= bn, r has an limbs; returns borrow
+static limb_t sub(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    int carry = sub_n(r, a, b, bn);
+    for (std::size_t i = bn; i < an; i++) {
+        r[i] = a[i];
+        sub_limbs(r[i], 0, carry);
+    }
+    return carry;
+}
+
+// r = a * b, may alias; returns the high limb
+static limb_t mul_1(limb_t* r, const limb_t* a, std::size_t n, limb_t b) {
+    limb_t carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        dlimb_t t = (dlimb_t)a[i] * b + carry;
+        r[i] = t;
+        carry = t >> LIMB_BITS;
+    }
+    return carry;
+}
+
+// r += a * b; returns the high limb
+static limb_t addmul_1(limb_t* r, const limb_t* a, std::size_t n, limb_t b) {
+    limb_t carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        dlimb_t t = (dlimb_t)a[i] * b + r[i] + carry;
+        r[i] = t;
+        carry = t >> LIMB_BITS;
+    }
+    return carry;
+}
+
+// r -= a * b; returns the borrowed high limb
+static limb_t submul_1(limb_t* r, const limb_t* a, std::size_t n, limb_t b) {
+    limb_t carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        dlimb_t t = (dlimb_t)a[i] * b + carry;
+        limb_t lo = t;
+        carry = (t >> LIMB_BITS) + (r[i] < lo);
+        r[i] -= lo;
+    }
+    return carry;
+}
+
+// a /= d in place; returns the remainder
+static limb_t divrem_1(limb_t* a, std::size_t n, limb_t d) {
+    dlimb_t rem = 0;
+    for (std::size_t i = n; i-- > 0;) {
+        dlimb_t t = (rem << LIMB_BITS) | a[i];
+        a[i] = t / d;
+        rem = t % d;
+    }
+    return rem;
+}
+
+// a >>= shift in place, 0 < shift < LIMB_BITS
+static void rshift(limb_t* a, std::size_t n, int shift) {
+    for (std::size_t i = 0; i < n; i++) {
+        a[i] >>= shift;
+        if (i + 1 < n) {
+            a[i] |= a[i + 1] << (LIMB_BITS - shift);
+        }
+    }
+}
+
+// r = a << shift, 0 < shift < LIMB_BITS, may alias; returns bits shifted out
+static limb_t lshift(limb_t* r, const limb_t* a, std::size_t n, int shift) {
+    limb_t carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        limb_t new_carry = a[i] >> (LIMB_BITS - shift);
+        r[i] = (a[i] << shift) | carry;
+        carry = new_carry;
+    }
+    return carry;
+}
+
+static std::size_t normalized_size(const limb_t* a, std::size_t n) {
+    while (n > 0 && a[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+// sign of a - b
+static int compare(const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    an = normalized_size(a, an);
+    bn = normalized_size(b, bn);
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    for (std::size_t i = an; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// limb i of b << s for s < LIMB_BITS, i <= bn
+static limb_t shifted_limb(const limb_t* b, std::size_t bn, int s, std::size_t i) {
+    limb_t limb = i < bn ? b[i] << s : 0;
+    if (s != 0 && i > 0) {
+        limb |= b[i - 1] >> (LIMB_BITS - s);
+    }
+    return limb;
+}
+
+// limbs of b << s without a top zero limb, b has a non-zero top limb
+static std::size_t shifted_size(const limb_t* b, std::size_t bn, int s) {
+    return bn > 0 && s != 0 && (b[bn - 1] >> (LIMB_BITS - s)) != 0 ? bn + 1 : bn;
+}
+
+// sign of a * B^a_offset - (b << s) * B^b_offset for s < LIMB_BITS, the top limbs are non-zero
+static int compare_offset(const limb_t* a, std::size_t an, std::size_t a_offset, const limb_t* b, std::size_t bn, std::size_t b_offset, int s = 0) {
+    std::size_t sn = shifted_size(b, bn, s);
+    if (an == 0 || sn == 0) {
+        return (an != 0) - (sn != 0);
+    }
+    std::size_t a_top = an + a_offset;
+    std::size_t b_top = sn + b_offset;
+    if (a_top != b_top) {
+        return a_top < b_top ? -1 : 1;
+    }
+    std::size_t low = std::max(a_offset, b_offset);
+    for (std::size_t i = a_top; i-- > low;) {
+        limb_t b_limb = shifted_limb(b, bn, s, i - b_offset);
+        if (a[i - a_offset] != b_limb) {
+            return a[i - a_offset] < b_limb ? -1 : 1;
+        }
+    }
+    // below that only one of them has stored limbs
+    if (a_offset < low) {
+        return normalized_size(a, low - a_offset) != 0 ? 1 : 0;
+    }
+    for (std::size_t j = 0; j + b_offset < low; j++) {
+        if (shifted_limb(b, bn, s, j) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// r[0..rn) += b << s for s < LIMB_BITS, rn >= bn; returns carry
+static limb_t add_shifted(limb_t* r, std::size_t rn, const limb_t* b, std::size_t bn, int s) {
+    if (s == 0) {
+        return add(r, r, rn, b, bn);
+    }
+    int carry = 0;
+    std::size_t i = 0;
+    for (; i < std::min(rn, bn + 1); i++) {
+        add_limbs(r[i], shifted_limb(b, bn, s, i), carry);
+    }
+    for (; i < rn && carry != 0; i++) {
+        add_limbs(r[i], 0, carry);
+    }
+    return carry;
+}
+
+// r[0..rn) -= b << s for s < LIMB_BITS, rn >= bn; the result is non-negative
+static void sub_shifted(limb_t* r, std::size_t rn, const limb_t* b, std::size_t bn, int s) {
+    [[maybe_unused]] limb_t borrow;
+    if (s == 0) {
+        borrow = sub(r, r, rn, b, bn);
+    } else {
+        int carry = 0;
+        std::size_t i = 0;
+        for (; i < std::min(rn, bn + 1); i++) {
+            sub_limbs(r[i], shifted_limb(b, bn, s, i), carry);
+        }
+        for (; i < rn && carry != 0; i++) {
+            sub_limbs(r[i], 0, carry);
+        }
+        borrow = carry;
+    }
+    assert(borrow == 0);
+}
+
+// r[0..rn) = (b << s) * B^d - r[0..rn) for s < LIMB_BITS, rn = d + limbs of b << s; the result is non-negative
+static void rsub_shifted(limb_t* r, std::size_t rn, std::size_t d, const limb_t* b, std::size_t bn, int s) {
+    int carry = 0;
+    for (std::size_t i = 0; i < rn; i++) {
+        limb_t limb = i >= d ? shifted_limb(b, bn, s, i - d) : 0;
+        sub_limbs(limb, r[i], carry);
+        r[i] = limb;
+    }
+    assert(carry == 0);
+}
+
+// r[0..rn) += a, the sum must fit into rn limbs
+static void add_into(limb_t* r, std::size_t rn, const limb_t* a, std::size_t an) {
+    an = normalized_size(a, an);
+    assert(an <= rn);
+    [[maybe_unused]] limb_t carry = add(r, r, rn, a, an);
+    assert(carry == 0);
+}
+
+// r = a << s, r has an + s / LIMB_BITS + 1 limbs and doesn't alias
+static void shift_into(limb_t* r, const limb_t* a, std::size_t an, std::size_t s) {
+    std::fill(r, r + s / LIMB_BITS, 0);
+    limb_t* shifted = r + s / LIMB_BITS;
+    if (s % LIMB_BITS != 0) {
+        shifted[an] = lshift(shifted, a, an, s % LIMB_BITS);
+    } else {
+        std::copy(a, a + an, shifted);
+        shifted[an] = 0;
+    }
+}
+
+// a per-thread stack of limbs that the kernels take their temporaries from through Scratch;
+// the blocks are kept between operations and merged into one once nothing is in use,
+// so an operation repeated at the same sizes doesn't allocate
+struct ScratchStack {
+    std::vector<std::unique_ptr<limb_t[]>> blocks;
+    std::vector<std::size_t> sizes;
+    // the top of the stack is at blocks[block] + top
+    std::size_t block = 0;
+    std::size_t top = 0;
+    std::size_t in_use = 0;
+    std::size_t high_water = 0;
+
+    limb_t* take(std::size_t n) {
+        if (blocks.empty() || top + n > sizes[block]) {
+            // everything past the top is free, the rest of the current block is skipped
+            std::size_t next = blocks.empty() ? 0 : block + 1;
+            if (next == blocks.size() || sizes[next] < n) {
+                std::size_t capacity = 0;
+                for (std::size_t size : sizes) {
+                    capacity += size;
+                }
+                std::size_t size = std::max(n, capacity);
+                blocks.insert(blocks.begin() + next, std::make_unique_for_overwrite<limb_t[]>(size));
+                sizes.insert(sizes.begin() + next, size);
+            }
+            block = next;
+            top = 0;
+        }
+        limb_t* limbs = blocks[block].get() + top;
+        top += n;
+        in_use += n;
+        high_water = std::max(high_water, in_use);
+        return limbs;
+    }
+
+    void give_back(std::size_t n, std::size_t saved_block, std::size_t saved_top) {
+        block = saved_block;
+        top = saved_top;
+        in_use -= n;
+        if (in_use == 0 && blocks.size() > 1) {
+            // a single block of the peak use holds the same temporaries without skipping
+            blocks.clear();
+            sizes.clear();
+            blocks.push_back(std::make_unique_for_overwrite<limb_t[]>(high_water));
+            sizes.push_back(high_water);
+            block = 0;
+            top = 0;
+        }
+    }
+
+    // frees the blocks past the one in use, all of them when called between operations
+    void trim() {
+        std::size_t keep = in_use == 0 ? 0 : block + 1;
+        blocks.resize(keep);
+        sizes.resize(keep);
+        if (keep == 0) {
+            block = 0;
+            top = 0;
+        }
+        high_water = in_use;
+    }
+};
+
+static ScratchStack& scratch_stack() {
+    thread_local ScratchStack stack;
+    return stack;
+}
+
+// n zeroed temporary limbs from the scratch stack of the thread, given back on destruction;
+// they have to be destroyed in the reverse order of creation, which holds for local variables
+class Scratch {
+    ScratchStack& stack;
+    std::size_t saved_block;
+    std::size_t saved_top;
+    std::size_t n;
+    limb_t* limbs;
+
+public:
+    explicit Scratch(std::size_t _n) : stack(scratch_stack()), saved_block(stack.block), saved_top(stack.top), n(_n) {
+        limbs = n > 0 ? stack.take(n) : nullptr;
+        std::fill(limbs, limbs + n, 0);
+    }
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+    ~Scratch() {
+        if (n > 0) {
+            stack.give_back(n, saved_block, saved_top);
+        }
+    }
+
+    limb_t* data() const {
+        return limbs;
+    }
+    std::size_t size() const {
+        return n;
+    }
+    limb_t* begin() const {
+        return limbs;
+    }
+    limb_t* end() const {
+        return limbs + n;
+    }
+    limb_t& operator[](std::size_t i) const {
+        return limbs[i];
+    }
+};
+
+static void mul_limbs(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn);
+
+// r = a * b, r has an + bn limbs and doesn't alias, bn > 0
+static void mul_schoolbook(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    r[an] = mul_1(r, a, an, b[0]);
+    for (std::size_t i = 1; i < bn; i++) {
+        r[an + i] = addmul_1(r + i, a, an, b[i]);
+    }
+}
+
+// r = a * a, r has 2 * n limbs and doesn't alias, n > 0
+// every cross product a[i] * a[j] is computed once and doubled
+static void sqr_schoolbook(limb_t* r, const limb_t* a, std::size_t n) {
+    std::fill(r, r + 2 * n, 0);
+    for (std::size_t i = 0; i + 1 < n; i++) {
+        r[n + i] = addmul_1(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    }
+    lshift(r, r, 2 * n, 1);
+    int carry = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        dlimb_t square = (dlimb_t)a[i] * a[i];
+        add_limbs(r[2 * i], square, carry);
+        add_limbs(r[2 * i + 1], square >> LIMB_BITS, carry);
+    }
+    assert(carry == 0);
+}
+
+// requires an >= bn > (an + 1) / 2
+// when a and b are the same array, all three products are squares
+static void mul_karatsuba(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    std::size_t h = (an + 1) / 2;
+    const limb_t* a1 = a + h;
+    const limb_t* b1 = b + h;
+    std::size_t a1n = an - h;
+    std::size_t b1n = bn - h;
+
+    // z0 and z2 go straight to their places in the result
+    mul_limbs(r, a, h, b, h);
+    mul_limbs(r + 2 * h, a1, a1n, b1, b1n);
+
+    Scratch sa(h + 1), sb(a == b ? 0 : h + 1), z1(2 * h + 2);
+    sa[h] = add(sa.data(), a, h, a1, a1n);
+    if (a == b) {
+        mul_limbs(z1.data(), sa.data(), h + 1, sa.data(), h + 1);
+    } else {
+        sb[h] = add(sb.data(), b, h, b1, b1n);
+        mul_limbs(z1.data(), sa.data(), h + 1, sb.data(), h + 1);
+    }
+
+    // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    [[maybe_unused]] limb_t borrow = sub(z1.data(), z1.data(), z1.size(), r, 2 * h);
+    borrow |= sub(z1.data(), z1.data(), z1.size(), r + 2 * h, a1n + b1n);
+    assert(borrow == 0);
+    add_into(r + h, an + bn - h, z1.data(), z1.size());
+}
+
+// requires an >= bn > 2 * ceil(an / 3)
+// evaluates at 0, 1, -1, 2, inf and interpolates keeping every intermediate non-negative
+// when a and b are the same array, it is evaluated once and all five products are squares
+static void mul_toom3(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    std::size_t k = (an + 2) / 3;
+    std::size_t a2n = an - 2 * k;
+    std::size_t b2n = bn - 2 * k;
+    const limb_t *a0 = a, *a1 = a + k, *a2 = a + 2 * k;
+    const limb_t *b0 = b, *b1 = b + k, *b2 = b + 2 * k;
+
+    // values at 1, -1 and 2, each fits into k + 1 limbs
+    auto evaluate = [k](const limb_t* x0, const limb_t* x1, const limb_t* x2, std::size_t x2n,
+                        limb_t* at1, limb_t* atm1, limb_t* at2) {
+        // x0 + x2
+        Scratch even(k + 1);
+        even[k] = add(even.data(), x0, k, x2, x2n);
+        at1[k] = even[k] + add(at1, even.data(), k, x1, k);
+        // |x0 - x1 + x2| with sign
+        bool negative = false;
+        Scratch x1_ext(k + 1);
+        std::copy(x1, x1 + k, x1_ext.begin());
+        if (compare(even.data(), k + 1, x1_ext.data(), k + 1) < 0) {
+            negative = true;
+            sub_n(atm1, x1_ext.data(), even.data(), k + 1);
+        } else {
+            sub_n(atm1, even.data(), x1_ext.data(), k + 1);
+        }
+        // x0 + 2 * x1 + 4 * x2 = ((x2 * 2 + x1) * 2) + x0
+        std::fill(at2, at2 + k + 1, 0);
+        std::copy(x2, x2 + x2n, at2);
+        lshift(at2, at2, k + 1, 1);
+        add(at2, at2, k + 1, x1, k);
+        lshift(at2, at2, k + 1, 1);
+        add(at2, at2, k + 1, x0, k);
+        return negative;
+    };
+
+    std::size_t n = k + 1;
+    std::size_t m = 2 * n + 1;
+    Scratch ea1(n), eam1(n), ea2(n), eb1(a == b ? 0 : n), ebm1(a == b ? 0 : n), eb2(a == b ? 0 : n);
+    bool negative = evaluate(a0, a1, a2, a2n, ea1.data(), eam1.data(), ea2.data());
+    const limb_t *pb1 = ea1.data(), *pbm1 = eam1.data(), *pb2 = ea2.data();
+    if (a == b) {
+        negative = false;
+    } else {
+        negative ^= evaluate(b0, b1, b2, b2n, eb1.data(), ebm1.data(), eb2.data());
+        pb1 = eb1.data();
+        pbm1 = ebm1.data();
+        pb2 = eb2.data();
+    }
+
+    Scratch v1(m), vm1(m), v2(m), c0(m), c4(m);
+    mul_limbs(v1.data(), ea1.data(), n, pb1, n);
+    mul_limbs(vm1.data(), eam1.data(), n, pbm1, n);
+    mul_limbs(v2.data(), ea2.data(), n, pb2, n);
+    mul_limbs(c0.data(), a0, k, b0, k);
+    mul_limbs(c4.data(), a2, a2n, b2, b2n);
+
+    // t1 = c0 + c2 + c4, t2 = c1 + c3
+    Scratch t1(m), t2(m);
+    if (negative) {
+        sub_n(t1.data(), v1.data(), vm1.data(), m);
+        add_n(t2.data(), v1.data(), vm1.data(), m);
+    } else {
+        add_n(t1.data(), v1.data(), vm1.data(), m);
+        sub_n(t2.data(), v1.data(), vm1.data(), m);
+    }
+    rshift(t1.data(), m, 1);
+    rshift(t2.data(), m, 1);
+
+    Scratch& c2 = t1;
+    sub_n(c2.data(), c2.data(), c0.data(), m);
+    sub_n(c2.data(), c2.data(), c4.data(), m);
+
+    // u = (v2 - c0 - 4 * c2 - 16 * c4) / 2 = c1 + 4 * c3
+    Scratch& u = v2;
+    Scratch scaled(m);
+    sub_n(u.data(), u.data(), c0.data(), m);
+    lshift(scaled.data(), c2.data(), m, 2);
+    sub_n(u.data(), u.data(), scaled.data(), m);
+    lshift(scaled.data(), c4.data(), m, 4);
+    sub_n(u.data(), u.data(), scaled.data(), m);
+    rshift(u.data(), m, 1);
+
+    Scratch& c3 = u;
+    sub_n(c3.data(), c3.data(), t2.data(), m);
+    [[maybe_unused]] limb_t rem = divrem_1(c3.data(), m, 3);
+    assert(rem == 0);
+    Scratch& c1 = t2;
+    sub_n(c1.data(), c1.data(), c3.data(), m);
+
+    std::size_t rn = an + bn;
+    std::fill(r, r + rn, 0);
+    std::copy(c0.begin(), c0.begin() + 2 * k, r);
+    std::copy(c4.begin(), c4.begin() + a2n + b2n, r + 4 * k);
+    add_into(r + k, rn - k, c1.data(), m);
+    add_into(r + 2 * k, rn - 2 * k, c2.data(), m);
+    add_into(r + 3 * k, rn - 3 * k, c3.data(), m);
+}
+
+// modular arithmetic in Montgomery form for an odd modulus p < 2^62
+struct Montgomery {
+    uint64_t p;
+    uint64_t p_neg_inv; // -p^(-1) mod 2^64
+    uint64_t r2; // 2^128 mod p
+
+    // x + p if x went below zero, without a branch: the transforms feed it unpredictable values
+    uint64_t correct(uint64_t x) const {
+        return x + (p & -(x >> 63));
+    }
+
+    explicit Montgomery(uint64_t _p) : p(_p) {
+        uint64_t inv = p;
+        for (int i = 0; i < 5; i++) {
+            inv *= 2 - p * inv;
+        }
+        p_neg_inv = -inv;
+        uint128_t r = (uint128_t)1 << 64;
+        r2 = (r % p) * (r % p) % p;
+    }
+
+    uint64_t reduce(uint128_t t) const {
+        uint64_t m = (uint64_t)t * p_neg_inv;
+        uint64_t u = (t + (uint128_t)m * p) >> 64;
+        return correct(u - p);
+    }
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        return reduce((uint128_t)a * b);
+    }
+
+    uint64_t add(uint64_t a, uint64_t b) const {
+        return correct(a + b - p);
+    }
+
+    uint64_t sub(uint64_t a, uint64_t b) const {
+        return correct(a - b);
+    }
+
+    uint64_t to_form(uint64_t a) const {
+        return mul(a, r2);
+    }
+
+    uint64_t from_form(uint64_t a) const {
+        return reduce(a);
+    }
+
+    // both base and result are in Montgomery form
+    uint64_t pow(uint64_t base, uint64_t e) const {
+        uint64_t result = to_form(1);
+        while (e != 0) {
+            if (e & 1) {
+                result = mul(result, base);
+            }
+            base = mul(base, base);
+            e >>= 1;
+        }
+        return result;
+    }
+};
+
+// primes of the form 3c * 2^k + 1 with k >= 50, so transforms can have lengths 2^k and 3 * 2^k;
+// their product is above 2^185, enough for exact convolutions of whole 64-bit limbs of any practical length
+const std::array<uint64_t, 3> NTT_PRIMES = {4546383823830515713ull, 4522739925786820609ull, 4512606826625236993ull};
+const std::array<uint64_t, 3> NTT_GENERATORS = {10, 37, 7};
+
+// the transform length for a product of rn limbs: the smallest 2^k or 3 * 2^k that holds it
+static std::size_t ntt_size(std::size_t rn) {
+    std::size_t n = std::bit_ceil(rn);
+    return n >= 4 && n / 4 * 3 >= rn ? n / 4 * 3 : n;
+}
+
+// w[j] = root^j in Montgomery form for j < n, as two interleaved chains of multiplications
+static void root_powers(uint64_t* w, std::size_t n, const Montgomery m, uint64_t root) {
+    if (n == 0) {
+        return;
+    }
+    w[0] = m.to_form(1);
+    if (n > 1) {
+        w[1] = root;
+    }
+    uint64_t root2 = m.mul(root, root);
+    for (std::size_t j = 2; j < n; j++) {
+        w[j] = m.mul(w[j - 2], root2);
+    }
+}
+
+// forward transform of length 2^k or 3 * 2^k, natural order in, permuted order out
+// m is taken by value so that the stores into a don't make the compiler reload it
+static void ntt_forward(uint64_t* a, std::size_t n, const Montgomery m, uint64_t root) {
+    if (n % 3 == 0) {
+        // a radix-3 step leaves three transforms of length n / 3 with the root cubed
+        std::size_t third = n / 3;
+        uint64_t w3 = m.pow(root, third);
+        uint64_t w = m.to_form(1);
+        for (std::size_t j = 0; j < third; j++) {
+            uint64_t a0 = a[j], a1 = a[j + third], a2 = a[j + 2 * third];
+            // w3^2 = -1 - w3, so both mixed outputs share a single multiplication
+            uint64_t d = m.mul(m.sub(a1, a2), w3);
+            a[j] = m.add(m.add(a0, a1), a2);
+            a[j + third] = m.mul(m.add(m.sub(a0, a2), d), w);
+            a[j + 2 * third] = m.mul(m.sub(m.sub(a0, a1), d), m.mul(w, w));
+            w = m.mul(w, root);
+        }
+        uint64_t root3 = m.pow(root, 3);
+        for (int block = 0; block < 3; block++) {
+            ntt_forward(a + block * third, third, m, root3);
+        }
+        return;
+    }
+    // powers of the root, a level of length len takes every n / (2 * len)-th of them
+    Scratch w(n / 2);
+    root_powers(w.data(), n / 2, m, root);
+    for (std::size_t len = n / 2; len >= 1; len /= 2) {
+        std::size_t stride = n / (2 * len);
+        for (std::size_t i = 0; i < n; i += 2 * len) {
+            for (std::size_t j = 0; j < len; j++) {
+                uint64_t u = a[i + j];
+                uint64_t v = a[i + j + len];
+                a[i + j] = m.add(u, v);
+                a[i + j + len] = m.mul(m.sub(u, v), w[j * stride]);
+            }
+        }
+    }
+}
+
+// inverse of ntt_forward with the same root, permuted order in, natural order out, without the 1/n scaling
+static void ntt_inverse(uint64_t* a, std::size_t n, const Montgomery m, uint64_t root) {
+    uint64_t inv_root = m.pow(root, m.p - 2);
+    if (n % 3 == 0) {
+        std::size_t third = n / 3;
+        uint64_t root3 = m.pow(root, 3);
+        for (int block = 0; block < 3; block++) {
+            ntt_inverse(a + block * third, third, m, root3);
+        }
+        // the radix-3 step of ntt_forward with the inverse roots
+        uint64_t w3 = m.pow(inv_root, third);
+        uint64_t w = m.to_form(1);
+        for (std::size_t j = 0; j < third; j++) {
+            uint64_t a0 = a[j], a1 = m.mul(a[j + third], w), a2 = m.mul(a[j + 2 * third], m.mul(w, w));
+            uint64_t d = m.mul(m.sub(a1, a2), w3);
+            a[j] = m.add(m.add(a0, a1), a2);
+            a[j + third] = m.add(m.sub(a0, a2), d);
+            a[j + 2 * third] = m.sub(m.sub(a0, a1), d);
+            w = m.mul(w, inv_root);
+        }
+        return;
+    }
+    Scratch w(n / 2);
+    root_powers(w.data(), n / 2, m, inv_root);
+    for (std::size_t len = 1; len < n; len *= 2) {
+        std::size_t stride = n / (2 * len);
+        for (std::size_t i = 0; i < n; i += 2 * len) {
+            for (std::size_t j = 0; j < len; j++) {
+                uint64_t u = a[i + j];
+                uint64_t v = m.mul(a[i + j + len], w[j * stride]);
+                a[i + j] = m.add(u, v);
+                a[i + j + len] = m.sub(u, v);
+            }
+        }
+    }
+}
+
+// fa = cyclic convolution of the limbs of a and b modulo NTT_PRIMES[idx], n entries in normal form
+// when a and b are the same array a single forward transform is needed
+static void ntt_convolve(uint64_t* fa, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn, std::size_t n, int idx) {
+    const Montgomery m(NTT_PRIMES[idx]);
+    uint64_t root = m.pow(m.to_form(NTT_GENERATORS[idx]), (m.p - 1) / n);
+    std::fill(fa, fa + n, 0);
+    for (std::size_t i = 0; i < an; i++) {
+        fa[i] = m.to_form(a[i]);
+    }
+    ntt_forward(fa, n, m, root);
+    if (a == b && an == bn) {
+        for (std::size_t i = 0; i < n; i++) {
+            fa[i] = m.mul(fa[i], fa[i]);
+        }
+    } else {
+        Scratch fb(n);
+        for (std::size_t i = 0; i < bn; i++) {
+            fb[i] = m.to_form(b[i]);
+        }
+        ntt_forward(fb.data(), n, m, root);
+        for (std::size_t i = 0; i < n; i++) {
+            fa[i] = m.mul(fa[i], fb[i]);
+        }
+    }
+    ntt_inverse(fa, n, m, root);
+    uint64_t n_inv = m.pow(m.to_form(n), m.p - 2);
+    for (std::size_t i = 0; i < n; i++) {
+        fa[i] = m.from_form(m.mul(fa[i], n_inv));
+    }
+}
+
+// r = a * b mod (B^n - 1) through three cyclic convolutions of length n recombined with the CRT
+// (Garner's algorithm); n is a transform length, an, bn <= n and r has min(an + bn, n) limbs
+static void mul_ntt_cyclic(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn, std::size_t n) {
+    std::size_t rn = std::min(an + bn, n);
+    Scratch convolutions(3 * n);
+    std::array<const uint64_t*, 3> residues;
+    for (int idx = 0; idx < 3; idx++) {
+        ntt_convolve(convolutions.data() + idx * n, a, an, b, bn, n, idx);
+        residues[idx] = convolutions.data() + idx * n;
+    }
+
+    const uint64_t p0 = NTT_PRIMES[0], p1 = NTT_PRIMES[1], p2 = NTT_PRIMES[2];
+    static const Montgomery m1(p1), m2(p2);
+    // constants in Montgomery form so a single reduction multiplies by them
+    static const uint64_t p0_inv_mod_p1 = m1.pow(m1.to_form(p0 % p1), p1 - 2);
+    static const uint64_t p0_mod_p2 = m2.to_form(p0 % p2);
+    static const uint64_t p0p1_inv_mod_p2 = m2.pow(m2.mul(m2.to_form(p0 % p2), m2.to_form(p1 % p2)), p2 - 2);
+    const uint128_t p0p1 = (uint128_t)p0 * p1;
+
+    // 192-bit accumulator, little-endian words
+    std::array<uint64_t, 3> acc = {0, 0, 0};
+    auto add_at = [&acc](uint128_t value, int word) {
+        uint128_t lo = (uint128_t)acc[word] + (uint64_t)value;
+        acc[word] = lo;
+        uint128_t hi = (uint128_t)acc[word + 1] + (uint64_t)(value >> 64) + (uint64_t)(lo >> 64);
+        acc[word + 1] = hi;
+        if (word == 0) {
+            acc[2] += (uint64_t)(hi >> 64);
+        }
+    };
+    // the primes are within a factor of two of each other, so a residue reduces to a smaller prime by a subtraction
+    auto reduce = [](uint64_t x, uint64_t p) {
+        return x >= p ? x - p : x;
+    };
+    for (std::size_t i = 0; i < rn; i++) {
+        uint64_t x1 = residues[0][i];
+        uint64_t x2 = m1.mul(m1.sub(residues[1][i], reduce(x1, p1)), p0_inv_mod_p1);
+        uint64_t t = m2.add(reduce(x1, p2), m2.mul(reduce(x2, p2), p0_mod_p2));
+        uint64_t x3 = m2.mul(m2.sub(residues[2][i], t), p0p1_inv_mod_p2);
+        // x1 + x2 * p0 + x3 * p0 * p1
+        add_at((uint128_t)x2 * p0 + x1, 0);
+        add_at((uint128_t)x3 * (uint64_t)p0p1, 0);
+        add_at((uint128_t)x3 * (uint64_t)(p0p1 >> 64), 1);
+        r[i] = acc[0];
+        acc[0] = acc[1];
+        acc[1] = acc[2];
+        acc[2] = 0;
+    }
+    if (rn < an + bn) {
+        // the carry out of the top limb wraps around, as B^n = 1
+        limb_t carry = add(r, r, n, acc.data(), 3);
+        while (carry != 0) {
+            carry = add(r, r, n, &carry, 1);
+        }
+        return;
+    }
+    assert(acc[0] == 0 && acc[1] == 0 && acc[2] == 0);
+}
+
+// r = a * b through transforms long enough for the whole product
+static void mul_ntt(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    mul_ntt_cyclic(r, a, an, b, bn, ntt_size(an + bn));
+}
+
+// whether transforms of length n are faster than the Toom-3 path for an an x bn product, an >= bn:
+// the transforms cost about n log n, Toom-3 about bn^1.465 per bn-sized piece of a; the factors
+// are fitted to measurements of both at -O3, a square saves a third of the transforms
+// and about a quarter of Toom-3
+static bool ntt_wins_at(std::size_t n, std::size_t an, std::size_t bn, bool square) {
+    if (bn < NTT_THRESHOLD) {
+        return false;
+    }
+    double ntt = (square ? 1.2 : 1.75) * n * std::log2(n);
+    double toom = (square ? 1.15 : 1.55) * std::pow(bn, 1.465) * an / bn;
+    return ntt < toom;
+}
+
+// whether mul_ntt is faster than the Toom-3 path, for transforms padded to the whole product
+static bool ntt_wins(std::size_t an, std::size_t bn, bool square) {
+    return ntt_wins_at(ntt_size(an + bn), an, bn, square);
+}
+
+// r = a * b, r has an + bn limbs and doesn't alias the operands
+// passing the same array as a and b selects the squaring variant of each tier
+static void mul_limbs(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn) {
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    if (bn == 0) {
+        std::fill(r, r + an, 0);
+        return;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        if (a == b && an == bn) {
+            sqr_schoolbook(r, a, an);
+        } else {
+            mul_schoolbook(r, a, an, b, bn);
+        }
+        return;
+    }
+    if (ntt_wins(an, bn, a == b && an == bn)) {
+        mul_ntt(r, a, an, b, bn);
+        return;
+    }
+    if (bn <= (an + 1) / 2) {
+        // too unbalanced for splitting: multiply b by bn-sized pieces of a
+        Scratch piece(2 * bn);
+        std::fill(r, r + an + bn, 0);
+        for (std::size_t i = 0; i < an; i += bn) {
+            std::size_t n = std::min(bn, an - i);
+            mul_limbs(piece.data(), a + i, n, b, bn);
+            add_into(r + i, an + bn - i, piece.data(), n + bn);
+        }
+        return;
+    }
+    if (bn < TOOM3_THRESHOLD || bn <= 2 * ((an + 2) / 3)) {
+        mul_karatsuba(r, a, an, b, bn);
+        return;
+    }
+    mul_toom3(r, a, an, b, bn);
+}
+
+// r = a mod (B^n - 1), r has n limbs and doesn't alias a
+static void fold(limb_t* r, const limb_t* a, std::size_t an, std::size_t n) {
+    std::copy(a, a + std::min(an, n), r);
+    std::fill(r + std::min(an, n), r + n, 0);
+    for (std::size_t i = n; i < an; i += n) {
+        limb_t carry = add(r, r, n, a + i, std::min(n, an - i));
+        while (carry != 0) {
+            carry = add(r, r, n, &carry, 1);
+        }
+    }
+}
+
+// the length n >= k of a product of an x bn limbs reduced mod B^n - 1 (see mul_wrap): a transform length
+// when cyclic transforms beat the full product, otherwise k itself
+static std::size_t wrap_size(std::size_t k, std::size_t an, std::size_t bn) {
+    std::size_t n = ntt_size(k);
+    an = std::min(an, n);
+    bn = std::min(bn, n);
+    if (an + bn > n && ntt_wins_at(n, std::max(an, bn), std::min(an, bn), false)) {
+        return n;
+    }
+    return k;
+}
+
+// r = a * b mod (B^n - 1), r has n limbs and doesn't alias the operands; zero may come out as B^n - 1
+// where a wrapped length from wrap_size is given, the wrapped part is never computed: the cyclic
+// transforms are as long as the result rather than the product, otherwise the full product is folded
+static void mul_wrap(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn, std::size_t n) {
+    bool square = a == b && an == bn;
+    Scratch folded_a(an > n ? n : 0), folded_b(bn > n && !square ? n : 0);
+    if (an > n) {
+        fold(folded_a.data(), a, an, n);
+        a = folded_a.data();
+        an = n;
+    }
+    if (bn > n) {
+        if (square) {
+            b = a;
+        } else {
+            fold(folded_b.data(), b, bn, n);
+            b = folded_b.data();
+        }
+        bn = n;
+    }
+    if (an + bn <= n) {
+        mul_limbs(r, a, an, b, bn);
+        std::fill(r + an + bn, r + n, 0);
+    } else if (ntt_size(n) == n && ntt_wins_at(n, std::max(an, bn), std::min(an, bn), square)) {
+        mul_ntt_cyclic(r, a, an, b, bn, n);
+    } else {
+        Scratch p(an + bn);
+        mul_limbs(p.data(), a, an, b, bn);
+        fold(r, p.data(), an + bn, n);
+    }
+}
+
+// whether skipping the columns below t < n of an n x n product beats the full one: schoolbook rows
+// always do, the splitting of mul_high only with most of the triangle skipped and not where the full
+// product goes through the transforms, which don't shrink with it
+static bool short_product_wins(std::size_t n, std::size_t t, bool square) {
+    if (n < KARATSUBA_THRESHOLD) {
+        return true;
+    }
+    return t * SHORT_PRODUCT_DEN >= n * SHORT_PRODUCT_NUM && !ntt_wins(n, n, square);
+}
+
+// r[0..an + bn) = sum of a[i] * b[j] * B^(i + j) over a set of index pairs that contains every
+// pair with i + j >= t, each pair at most once (Mulders' short product, here with any column t
+// and unbalanced operands); so the result is below a * b by less than 2t * B^(t + 1)
+// parts where skipping doesn't pay are multiplied in full, returns whether that made the result exact
+static bool mul_high(limb_t* r, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn, std::size_t t) {
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    std::fill(r, r + an + bn, 0);
+    if (bn == 0) {
+        return true;
+    }
+    if (t > an + bn - 2) {
+        return false;
+    }
+    // the low limbs of one operand only pair with the skipped columns of the other
+    std::size_t a_skip = t > bn - 1 ? t - (bn - 1) : 0;
+    std::size_t b_skip = t > an - 1 ? t - (an - 1) : 0;
+    if (a_skip != 0 || b_skip != 0) {
+        mul_high(r + a_skip + b_skip, a + a_skip, an - a_skip, b + b_skip, bn - b_skip, t - a_skip - b_skip);
+        return false;
+    }
+    // from here t < bn <= an
+    if (t == 0) {
+        mul_limbs(r, a, an, b, bn);
+        return true;
+    }
+    if (an > bn) {
+        // the limbs of a from bn on pair with all of b
+        if (ntt_wins(an, bn, false)) {
+            mul_limbs(r, a, an, b, bn);
+            return true;
+        }
+        bool exact = mul_high(r, a, bn, b, bn, t);
+        Scratch rest(an);
+        mul_limbs(rest.data(), a + bn, an - bn, b, bn);
+        add_into(r + bn, an, rest.data(), an);
+        return exact;
+    }
+    std::size_t n = an;
+    bool square = a == b;
+    if (!short_product_wins(n, t, square)) {
+        mul_limbs(r, a, n, b, n);
+        return true;
+    }
+    if (n < 2 * KARATSUBA_THRESHOLD) {
+        // schoolbook rows starting from column t, half of them beat Karatsuba up to about twice its threshold
+        for (std::size_t i = 0; i < n; i++) {
+            std::size_t j = t > i ? t - i : 0;
+            r[i + n] = addmul_1(r + i + j, b + j, n - j, a[i]);
+        }
+        return false;
+    }
+    // the full product of the top k limbs covers i, j >= l; the rest of i + j >= t has i < l or j < l
+    // and then the other index from t - l + 1 on, two short products of l x (n - t + l - 1) limbs
+    std::size_t l = std::max<std::size_t>(1, (t + 1) * SHORT_PRODUCT_SPLIT / 100);
+    std::size_t k = n - l;
+    std::size_t from = t - l + 1;
+    mul_limbs(r + 2 * l, a + l, k, square ? a + l : b + l, k);
+    Scratch part(n - from + l);
+    mul_high(part.data(), a, l, b + from, n - from, l - 1);
+    add_into(r + from, 2 * n - from, part.data(), part.size());
+    if (!square) {
+        mul_high(part.data(), a + from, n - from, b, l, l - 1);
+    }
+    add_into(r + from, 2 * n - from, part.data(), part.size());
+    return false;
+}
+
+// result = (a * b) >> (LIMB_BITS * (s / LIMB_BITS)) with the bits from s upward exact, without computing
+// most of the limbs below s; bits below s are approximate and meant to be dropped by the caller
+// returns false when there are too few limbs below s or the skipped part could carry into bit s
+static bool mul_short(LimbVector& result, const limb_t* a, std::size_t an, const limb_t* b, std::size_t bn, unsigned int s) {
+    std::size_t cut = s / LIMB_BITS;
+    if (cut <= SHORT_PRODUCT_GUARD || cut >= an + bn) {
+        return false;
+    }
+    std::size_t t = cut - SHORT_PRODUCT_GUARD;
+    Scratch r(an + bn);
+    if (!mul_high(r.data(), a, an, b, bn, t)) {
+        // the skipped part can only carry into bit s if the bits of r
+        // from limb t + 1 up to bit s are all ones but the last few
+        limb_t top_mask = ((limb_t)1 << (s % LIMB_BITS)) - 1;
+        bool near_carry = (~r[cut] & top_mask) == 0;
+        for (std::size_t i = cut - 1; i > t + 1 && near_carry; i--) {
+            near_carry = r[i] == ~(limb_t)0;
+        }
+        if (near_carry && (limb_t)~r[t + 1] <= 2 * t) {
+            return false;
+        }
+    }
+    result.assign(r.data() + cut, r.data() + an + bn);
+    return true;
+}
+
+// q = u / d and u = u % d (Knuth's algorithm D), u has un limbs, d has dn > 0 limbs with
+// a non-zero top limb, q has un - dn + 1 limbs and doesn't alias; requires un >= dn
+static void divrem_schoolbook(limb_t* q, limb_t* u, std::size_t un, const limb_t* d, std::size_t dn) {
+    if (dn == 1) {
+        limb_t r = divrem_1(u, un, d[0]);
+        std::copy(u, u + un, q);
+        std::fill(u, u + un, 0);
+        u[0] = r;
+        return;
+    }
+    // normalize so that the top bit of the divisor is set, quotient digits are then
+    // estimated from the top two limbs and off by at most two
+    int s = std::countl_zero(d[dn - 1]);
+    Scratch v(dn), w(un + 1);
+    std::copy(d, d + dn, v.begin());
+    if (s != 0) {
+        lshift(v.data(), v.data(), dn, s);
+        w[un] = lshift(w.data(), u, un, s);
+    } else {
+        std::copy(u, u + un, w.begin());
+    }
+    limb_t v1 = v[dn - 1], v2 = v[dn - 2];
+    for (std::size_t j = un - dn + 1; j-- > 0;) {
+        dlimb_t top = ((dlimb_t)w[j + dn] << LIMB_BITS) | w[j + dn - 1];
+        dlimb_t qhat = top / v1;
+        dlimb_t rhat = top % v1;
+        while ((qhat >> LIMB_BITS) != 0 || qhat * v2 > ((rhat << LIMB_BITS) | w[j + dn - 2])) {
+            qhat--;
+            rhat += v1;
+            if ((rhat >> LIMB_BITS) != 0) {
+                break;
+            }
+        }
+        limb_t borrow = submul_1(w.data() + j, v.data(), dn, qhat);
+        if (w[j + dn] < borrow) {
+            // qhat was one too large
+            qhat--;
+            add_n(w.data() + j, w.data() + j, v.data(), dn);
+        }
+        w[j + dn] = 0;
+        q[j] = qhat;
+    }
+    if (s != 0) {
+        rshift(w.data(), dn, s);
+    }
+    std::copy(w.begin(), w.begin() + dn, u);
+    std::fill(u + dn, u + un, 0);
+}
+
+// x = B^(2n) / v up to a few units, v has n limbs with the top bit set, x has n + 2 limbs
+// the top half is computed recursively and refined by one Newton step x += x * (B^(2n) - v * x) / B^(2n),
+// where v * x wraps around mod B^(n + 2) - 1 and x times the top half of the difference is a short product,
+// so the cost is about two multiplications of size n
+static void reciprocal(limb_t* x, const limb_t* v, std::size_t n) {
+    std::fill(x, x + n + 2, 0);
+    if (n < RECIPROCAL_THRESHOLD) {
+        Scratch u(2 * n + 1);
+        u[2 * n] = 1;
+        divrem_schoolbook(x, u.data(), 2 * n + 1, v, n);
+        return;
+    }
+    // one limb more than half keeps the error of the step from growing
+    std::size_t h = n / 2 + 1;
+    Scratch xh(h + 2);
+    reciprocal(xh.data(), v + n - h, h);
+    std::size_t xhn = normalized_size(xh.data(), h + 2);
+    // e = |v * xh - B^(n + h)| is below a few B^n, so the product is only needed mod B^k - 1
+    // for k two limbs above v, where a negative difference shows as a non-zero top limb
+    std::size_t k = wrap_size(n + 2, n, xhn);
+    Scratch e(k);
+    mul_wrap(e.data(), v, n, xh.data(), xhn, k);
+    limb_t one = 1;
+    std::size_t power = (n + h) % k;
+    if (sub(e.data() + power, e.data() + power, k - power, &one, 1) != 0) {
+        sub(e.data(), e.data(), k, &one, 1);
+    }
+    bool over = e[k - 1] == 0;
+    if (!over) {
+        for (limb_t& limb : e) {
+            limb = ~limb;
+        }
+    }
+    std::size_t en = normalized_size(e.data(), k);
+    std::copy(xh.begin(), xh.begin() + xhn, x + n - h);
+    // x = xh * B^(n - h) +- xh * e / B^(2h), where the limbs of e below h - 1 and the columns
+    // of the product below h - 1 add up to less than a unit
+    if (en <= h - 1) {
+        return;
+    }
+    std::size_t drop = h - 1;
+    Scratch c(xhn + en - drop);
+    mul_high(c.data(), xh.data(), xhn, e.data() + drop, en - drop, h - 1);
+    if (c.size() <= h + 1) {
+        return;
+    }
+    std::size_t cn = normalized_size(c.data() + h + 1, c.size() - h - 1);
+    if (over) {
+        [[maybe_unused]] limb_t borrow = sub(x, x, n + 2, c.data() + h + 1, cn);
+        assert(borrow == 0);
+    } else {
+        add_into(x, n + 2, c.data() + h + 1, cn);
+    }
+}
+
+// x = reciprocal of the top n limbs of v, truncated or padded with zero limbs to that length;
+// v has dn limbs with the top bit set, x has n + 2 limbs
+static void reciprocal_of(limb_t* x, const limb_t* v, std::size_t dn, std::size_t n) {
+    Scratch vt(n);
+    if (dn >= n) {
+        std::copy(v + dn - n, v + dn, vt.begin());
+    } else {
+        std::copy(v, v + dn, vt.end() - dn);
+    }
+    reciprocal(x, vt.data(), n);
+}
+
+// q = u / d and u = u % d given v = d << s with the top bit set and x the reciprocal_of(v, dn, n),
+// where n > un - dn + 1 and dn >= 2; q has un - dn + 1 limbs and doesn't alias
+// a reciprocal longer than the quotient makes the estimate off by a few units at most,
+// the exact remainder then corrects it
+static void divrem_preinv(limb_t* q, limb_t* u, std::size_t un, const limb_t* v, std::size_t dn, int s, const limb_t* x, std::size_t n) {
+    std::size_t m = un - dn + 1;
+    std::size_t wn = un + 1;
+    Scratch w(wn);
+    if (s != 0) {
+        w[un] = lshift(w.data(), u, un, s);
+    } else {
+        std::copy(u, u + un, w.begin());
+    }
+    std::size_t xn = normalized_size(x, n + 2);
+    // dividend limbs below the second limb of the divisor add less than a unit to the quotient,
+    // and so do the columns of the product more than a limb below it
+    std::size_t drop = dn - 2;
+    std::size_t top = n + dn - drop;
+    Scratch p(wn - drop + xn);
+    mul_high(p.data(), w.data() + drop, wn - drop, x, xn, top - 2);
+    // the approximate quotient is the top of p
+    limb_t* qa = p.data() + top;
+    std::size_t qa_size = p.end() - qa;
+    std::size_t qn = normalized_size(qa, qa_size);
+
+    // r = w - qa * v is within a few v of zero, so it's computed mod B^k - 1 for k two limbs above v,
+    // a negative r shows as a non-zero top limb
+    std::size_t k = wrap_size(dn + 2, qn, dn);
+    Scratch r(k), wk(k);
+    mul_wrap(r.data(), qa, qn, v, dn, k);
+    fold(wk.data(), w.data(), wn, k);
+    limb_t one = 1;
+    if (sub(r.data(), wk.data(), k, r.data(), k) != 0) {
+        sub(r.data(), r.data(), k, &one, 1);
+    }
+    if (r[k - 1] != 0) {
+        // step qa down while r is negative, its magnitude is kept in r
+        for (limb_t& limb : r) {
+            limb = ~limb;
+        }
+        while (true) {
+            sub(qa, qa, qa_size, &one, 1);
+            if (compare(r.data(), k, v, dn) <= 0) {
+                // r = v - r
+                sub(r.data(), r.data(), k, v, dn);
+                for (limb_t& limb : r) {
+                    limb = ~limb;
+                }
+                add(r.data(), r.data(), k, &one, 1);
+                break;
+            }
+            sub(r.data(), r.data(), k, v, dn);
+        }
+    }
+    while (compare(r.data(), k, v, dn) >= 0) {
+        add(qa, qa, qa_size, &one, 1);
+        sub(r.data(), r.data(), k, v, dn);
+    }
+    assert(normalized_size(qa, qa_size) <= m);
+    std::copy(qa, qa + std::min(m, qa_size), q);
+    std::fill(q + std::min(m, qa_size), q + m, 0);
+    if (s != 0) {
+        rshift(r.data(), dn, s);
+    }
+    std::copy(r.begin(), r.begin() + dn, u);
+    std::fill(u + dn, u + un, 0);
+}
+
+// q = u / d and u = u % d given v and s as for divrem_preinv and x = reciprocal_of(v, dn, xn), xn >= 3;
+// shorter reciprocals are read off the top limbs of x, and quotients too long for it
+// are produced in blocks of at most xn - 2 limbs, each leaving a remainder below d for the next
+static void divrem_blocks(limb_t* q, limb_t* u, std::size_t un, const limb_t* v, std::size_t dn, int s, const limb_t* x, std::size_t xn) {
+    std::size_t m = un - dn + 1;
+    if (m + 1 <= xn) {
+        divrem_preinv(q, u, un, v, dn, s, x + xn - (m + 1), m + 1);
+        return;
+    }
+    // u[lo..un) holds a partial remainder below d
+    std::size_t lo = un - (dn - 1);
+    std::size_t blocks = (m + xn - 3) / (xn - 2);
+    std::size_t block = (m + blocks - 1) / blocks;
+    Scratch qc(xn);
+    while (lo > 0) {
+        std::size_t b = std::min(block, lo);
+        lo -= b;
+        std::size_t cn = std::min(lo + b + dn, un) - lo;
+        std::size_t cm = cn - dn + 1;
+        divrem_preinv(qc.data(), u + lo, cn, v, dn, s, x + xn - (cm + 1), cm + 1);
+        assert(cm == b || qc[b] == 0);
+        std::copy(qc.begin(), qc.begin() + b, q + lo);
+    }
+}
+
+// same contract as divrem_schoolbook, through a reciprocal of half the quotient but at most one limb longer
+// than the divisor, so that the quotient comes out in two blocks or more: for a 2n / n division
+// the reciprocal costs about one n-limb multiplication and each block another,
+// a reciprocal as long as the quotient costs twice as much and saves only half a multiplication
+static void divrem_newton(limb_t* q, limb_t* u, std::size_t un, const limb_t* d, std::size_t dn) {
+    int s = std::countl_zero(d[dn - 1]);
+    Scratch v(dn);
+    std::copy(d, d + dn, v.begin());
+    if (s != 0) {
+        lshift(v.data(), v.data(), dn, s);
+    }
+    std::size_t xn = std::min((un - dn + 1) / 2 + 3, dn + 1);
+    Scratch x(xn + 2);
+    reciprocal_of(x.data(), v.data(), dn, xn);
+    divrem_blocks(q, u, un, v.data(), dn, s, x.data(), xn);
+}
+
+// q = u / d and u = u % d, same contract as divrem_schoolbook
+static void divrem(limb_t* q, limb_t* u, std::size_t un, const limb_t* d, std::size_t dn) {
+    if (dn >= DIV_NEWTON_THRESHOLD && un - dn + 1 >= DIV_NEWTON_THRESHOLD) {
+        divrem_newton(q, u, un, d, dn);
+    } else {
+        divrem_schoolbook(q, u, un, d, dn);
+    }
+}
+
+// from PREINV_THRESHOLD limbs a divisor is prepared for repeated division: v = d << s with the top bit set
+// and x the reciprocal_of(v, dn, dn + 1), below that both are left empty
+static void prepare_divisor(const limb_t* d, std::size_t dn, std::vector<limb_t>& v, int& s, std::vector<limb_t>& x) {
+    if (dn < PREINV_THRESHOLD) {
+        return;
+    }
+    s = std::countl_zero(d[dn - 1]);
+    v.assign(d, d + dn);
+    if (s != 0) {
+        lshift(v.data(), v.data(), dn, s);
+    }
+    x.resize(dn + 3);
+    reciprocal_of(x.data(), v.data(), dn, dn + 1);
+}
+
+// q = u / d and u = u % d with v, s and x from prepare_divisor, same contract as divrem_schoolbook
+static void divrem_prepared(limb_t* q, limb_t* u, std::size_t un, const limb_t* d, std::size_t dn, const std::vector<limb_t>& v, int s, const std::vector<limb_t>& x) {
+    if (x.size() > 0 && un - dn + 1 >= PREINV_THRESHOLD / 4) {
+        divrem_blocks(q, u, un, v.data(), dn, s, x.data(), dn + 1);
+    } else {
+        divrem(q, u, un, d, dn);
+    }
+}
+
+LongNum::LongNum(int _sign, unsigned int _binary_point, LimbVector _limbs) : sign(_sign), binary_point(_binary_point), limbs(std::move(_limbs))  {
     fix_invariants();
 }
 
+LongNum::LongNum(bool negative, limb_t magnitude, std::pmr::memory_resource* resource) : limbs(resource) {
+    if (magnitude == 0) {
+        return;
+    }
+    sign = negative ? -1 : 1;
+    limb_offset = DEFAULT_PRECISION / LIMB_BITS;
+    limbs.push_back(magnitude);
+    static_assert(DEFAULT_PRECISION % LIMB_BITS == 0);
+}
+
+LongNum::LongNum(const allocator_type& alloc) : limbs(alloc.resource()) {}
+
+// the assignment copies the limbs unless other already uses the resource
+LongNum::LongNum(const LongNum& other, const allocator_type& alloc)
+    : sign(other.sign), binary_point(other.binary_point), limb_offset(other.limb_offset), limbs(alloc.resource()) {
+    limbs = other.limbs;
+}
+
+LongNum::LongNum(LongNum&& other, const allocator_type& alloc)
+    : sign(other.sign), binary_point(other.binary_point), limb_offset(other.limb_offset), limbs(alloc.resource()) {
+    limbs = std::move(other.limbs);
+}
+
+LongNum::allocator_type LongNum::get_allocator() const {
+    return limbs.get_resource();
+}
+
 inline void LongNum::verify_invariants() const {
     #ifndef NDEBUG
     if (sign != 1 && sign != -1) {
@@ -31,19 +1346,36 @@ inline void LongNum::verify_invariants() const {
     if (limbs.size() > 1 && limbs.back() == 0) {
         throw std::logic_error("Back limb is zero.");
     }
+    if (limbs.size() == 0 && limb_offset != 0) {
+        throw std::logic_error(std::format("Limb offset of zero is not 0; it's {}.", limb_offset));
+    }
     #endif
 }
 
 inline void LongNum::fix_invariants() {
-    while (limbs.size() > 0 && limbs.back() == 0) {
+    // read through a const reference, so that shared limbs aren't copied
+    const LimbVector& stored = limbs;
+    while (stored.size() > 0 && stored.back() == 0) {
         limbs.pop_back();
     }
     if (limbs.size() == 0) {
         sign = 1;
+        limb_offset = 0;
     }
     verify_invariants();
 }
 
+limb_t LongNum::limb_at(std::size_t i) const {
+    return i >= limb_offset && i - limb_offset < limbs.size() ? limbs[i - limb_offset] : 0;
+}
+
+void LongNum::lower_offset(std::size_t offset) {
+    if (limbs.size() > 0 && offset < limb_offset) {
+        limbs.insert(limbs.cbegin(), limb_offset - offset, 0);
+        limb_offset = offset;
+    }
+}
+
 LongNum::LongNum(long double value)
 {
     if (value == 0) {
@@ -58,21 +1390,27 @@ LongNum::LongNum(long double value)
         value = -value;
     }
     
-    std::vector<uint32_t> _limbs;
+    // the mantissa is taken in 32-bit chunks, so the precision is
+    // a multiple of 32 regardless of the limb size
+    std::vector<uint32_t> chunks;
     while (value) {
         value = std::ldexp(value, 32);
-        long double float_limb;
-        value = std::modf(value, &float_limb);
-        _limbs.emplace_back(float_limb);
+        long double float_chunk;
+        value = std::modf(value, &float_chunk);
+        chunks.emplace_back(float_chunk);
         exponent -= 32;
     }
     while (exponent > 0) {
-        _limbs.emplace_back(0);
+        chunks.emplace_back(0);
         exponent -= 32;
     }
     binary_point = -exponent;
-    limbs = std::vector<uint32_t>(_limbs.rbegin(), _limbs.rend());
-    verify_invariants();
+    limbs.resize((chunks.size() * 32 + LIMB_BITS - 1) / LIMB_BITS, 0);
+    for (int i = 0; i < (int)chunks.size(); i++) {
+        int pos = (chunks.size() - 1 - i) * 32;
+        limbs[pos / LIMB_BITS] |= (limb_t)chunks[i] << (pos % LIMB_BITS);
+    }
+    fix_invariants();
 }
 
 std::strong_ordering LongNum::operator<=>(const LongNum& rhs) const {
@@ -81,76 +1419,82 @@ std::strong_ordering LongNum::operator<=>(const LongNum& rhs) const {
         return std::strong_ordering::greater;
     } else if (sign < rhs.sign) {
         return std::strong_ordering::less;
-    } else if (bit_length() > rhs.bit_length()) {
-        return sign > 0 ? std::strong_ordering::greater : std::strong_ordering::less;
-    } else if (bit_length() < rhs.bit_length()) {
-        return sign > 0 ? std::strong_ordering::less : std::strong_ordering::greater;
     }
-    if (binary_point > rhs.binary_point) {
-        // fixme: slower but complicated to improve (see operator<<=)
-        LongNum new_rhs = rhs;
-        new_rhs.set_precision(binary_point);
-        return *this <=> new_rhs;
-    } else if (binary_point != rhs.binary_point) {
-        LongNum new_lhs = *this;
-        new_lhs.set_precision(rhs.binary_point);
-        return new_lhs <=> rhs;
-    }
-    for (int i = limbs.size() - 1; i >= 0; i--) {
-        if (limbs[i] > rhs.limbs[i]) {
-            return sign > 0 ? std::strong_ordering::greater : std::strong_ordering::less;
-        } else if (limbs[i] < rhs.limbs[i]) {
-            return sign > 0 ? std::strong_ordering::less : std::strong_ordering::greater;
-        }
-    }
-    return std::strong_ordering::equal;
+    // compare_magnitude settles it from the top limbs, bit_length would tell zeros of different precision apart
+    return sign * compare_magnitude(rhs) <=> 0;
 }
 
 bool LongNum::operator==(const LongNum& rhs) const {
     verify_invariants();
     rhs.verify_invariants();
-    if (binary_point > rhs.binary_point) {
-        // fixme: slower but complicated to improve (see operator<<=)
-        LongNum new_rhs = rhs;
-        new_rhs.set_precision(binary_point);
-        return *this == new_rhs;
-    } else if (binary_point != rhs.binary_point) {
-        return rhs == *this;
+    return sign == rhs.sign && compare_magnitude(rhs) == 0;
+}
+
+// the one with the lower precision is read shifted up by the difference: its whole limbs
+// go into the offset and the remaining bits are shifted in as the limbs are read
+int LongNum::compare_magnitude(const LongNum& rhs) const {
+    if (binary_point < rhs.binary_point) {
+        return -rhs.compare_magnitude(*this);
     }
-    return limbs == rhs.limbs && sign == rhs.sign;
+    std::size_t shift = binary_point - rhs.binary_point;
+    return compare_offset(limbs.data(), limbs.size(), limb_offset, rhs.limbs.data(), rhs.limbs.size(),
+                          rhs.limb_offset + shift / LIMB_BITS, shift % LIMB_BITS);
 }
 
-LongNum& LongNum::operator+=(const LongNum& rhs) {
-    verify_invariants();
-    rhs.verify_invariants();
-    if (rhs == 0) {
-        return *this;
+// the direction is settled by one comparison from the top limbs, then the limbs are added to or
+// subtracted from in place; when |rhs| is the larger one they are replaced by |rhs| - |this|
+void LongNum::add_signed(const LongNum& rhs, int rhs_sign) {
+    assert(binary_point >= rhs.binary_point);
+    std::size_t shift = binary_point - rhs.binary_point;
+    std::size_t rhs_offset = rhs.limb_offset + shift / LIMB_BITS;
+    int s = shift % LIMB_BITS;
+    std::size_t rn = shifted_size(rhs.limbs.data(), rhs.limbs.size(), s);
+    if (rn == 0) {
+        return;
     }
-    if (binary_point < rhs.binary_point) {
-        set_precision(rhs.binary_point);
+    if (limbs.size() == 0) {
+        sign = rhs_sign;
+        limb_offset = rhs_offset;
+    }
+    int order = 1;
+    if (sign != rhs_sign) {
+        order = compare_offset(limbs.data(), limbs.size(), limb_offset, rhs.limbs.data(), rhs.limbs.size(), rhs_offset, s);
+        if (order == 0) {
+            limbs.clear();
+            fix_invariants();
+            return;
+        }
     }
-    if (binary_point > rhs.binary_point) {
-        // fixme: slower but complicated to improve (see operator<<=)
-        LongNum new_rhs = rhs;
-        new_rhs.set_precision(binary_point);
-        *this += new_rhs;
-        return *this;
+    lower_offset(rhs_offset);
+    // the limbs of rhs start at d
+    std::size_t d = rhs_offset - limb_offset;
+    if (order > 0 && sign != rhs_sign) {
+        sub_shifted(limbs.data() + d, limbs.size() - d, rhs.limbs.data(), rhs.limbs.size(), s);
+        fix_invariants();
+        return;
     }
-    // ensure sign lhs = sign rhs or fall back to subtraction
-    if (sign != rhs.sign) {
-        *this -= -rhs;
-        return *this;
+    if (limbs.size() < d + rn) {
+        limbs.resize(d + rn, 0);
     }
-    int carry = 0;
-    for (int i = 0; i < (int)std::max(limbs.size(), rhs.limbs.size()); i++) {
-        if (i >= (int)limbs.size()) {
-            limbs.emplace_back(0);
-        }
-        add_limbs(limbs[i], i < (int)rhs.limbs.size() ? rhs.limbs[i] : 0, carry);
+    if (order < 0) {
+        rsub_shifted(limbs.data(), limbs.size(), d, rhs.limbs.data(), rhs.limbs.size(), s);
+        sign = rhs_sign;
+        fix_invariants();
+        return;
     }
-    if (carry == 1) {
-        limbs.emplace_back(1);
+    limb_t carry = add_shifted(limbs.data() + d, limbs.size() - d, rhs.limbs.data(), rhs.limbs.size(), s);
+    if (carry != 0) {
+        limbs.push_back(carry);
     }
+}
+
+LongNum& LongNum::operator+=(const LongNum& rhs) {
+    verify_invariants();
+    rhs.verify_invariants();
+    if (binary_point < rhs.binary_point) {
+        set_precision(rhs.binary_point);
+    }
+    add_signed(rhs, rhs.sign);
     verify_invariants();
     rhs.verify_invariants();
     return *this;
@@ -165,10 +1509,22 @@ LongNum operator+(LongNum lhs, const LongNum& rhs) {
     return lhs;
 }
 
-LongNum LongNum::operator-() const {
-    // fixme: would be used inefficiently with a copy
-    // even when not needed
-    // maybe some kind of no-copy views
+// whether an operator may write its result over the limbs of rhs: not when rhs is lhs,
+// and not when the result would have to move to the memory resource of lhs
+static bool can_reuse_rhs(const LongNum& lhs, const LongNum& rhs) {
+    return &lhs != &rhs && *lhs.get_allocator().resource() == *rhs.get_allocator().resource();
+}
+
+LongNum operator+(const LongNum& lhs, LongNum&& rhs) {
+    if (!can_reuse_rhs(lhs, rhs)) {
+        return LongNum(lhs) + rhs;
+    }
+    rhs += lhs;
+    return std::move(rhs);
+}
+
+LongNum LongNum::operator-() const& {
+    // the copy shares the limbs, so this is O(1)
     verify_invariants();
     LongNum result(*this);
     if (result != 0) {
@@ -178,41 +1534,23 @@ LongNum LongNum::operator-() const {
     return result;
 }
 
+LongNum LongNum::operator-() && {
+    verify_invariants();
+    if (limbs.size() != 0) {
+        sign = -sign;
+    }
+    verify_invariants();
+    return std::move(*this);
+}
+
 LongNum& LongNum::operator-=(const LongNum& rhs) {
     verify_invariants();
     rhs.verify_invariants();
-    if (rhs == 0) {
-        return *this;
-    }
-    if (*this == rhs) {
-        *this = 0;
-        return *this;
-    }
     if (binary_point < rhs.binary_point) {
         set_precision(rhs.binary_point);
     }
-    if (binary_point > rhs.binary_point) {
-        // fixme: slower but complicated to improve (see operator<<=)
-        LongNum new_rhs = rhs;
-        new_rhs.set_precision(binary_point);
-        *this -= new_rhs;
-        return *this;
-    }
-    // ensure |lhs| > |rhs| or fall back to addition
-    if (sign != rhs.sign) {
-        *this += -rhs;
-        return *this;
-    }
-    if ((*this < rhs) ^ (sign < 0)) {
-        *this = -(rhs - *this);
-        return *this;
-    }
-    int carry = 0;
-    for (int i = 0; i < (int)limbs.size(); i++) {
-        sub_limbs(limbs[i], i < (int)rhs.limbs.size() ? rhs.limbs[i] : 0, carry);
-    }
-    assert(carry == 0);
-    fix_invariants();
+    add_signed(rhs, -rhs.sign);
+    verify_invariants();
     rhs.verify_invariants();
     return *this;
 }
@@ -226,11 +1564,63 @@ LongNum operator-(LongNum lhs, const LongNum& rhs) {
     return lhs;
 }
 
+LongNum operator-(const LongNum& lhs, LongNum&& rhs) {
+    if (!can_reuse_rhs(lhs, rhs)) {
+        return LongNum(lhs) - rhs;
+    }
+    // lhs - rhs = -rhs + lhs
+    if (rhs.limbs.size() != 0) {
+        rhs.sign = -rhs.sign;
+    }
+    rhs += lhs;
+    return std::move(rhs);
+}
+
+LongNum& LongNum::add_native(bool negative, limb_t value) {
+    verify_invariants();
+    set_precision(std::max(binary_point, (unsigned int)DEFAULT_PRECISION));
+    if (value == 0) {
+        return *this;
+    }
+    if (limbs.size() == 0) {
+        sign = negative ? -1 : 1;
+    }
+    // value << binary_point takes two limbs from k on, counted in the stored limbs
+    std::size_t k = binary_point / LIMB_BITS;
+    int r = binary_point % LIMB_BITS;
+    limb_t addend[2] = {value << r, r == 0 ? 0 : value >> (LIMB_BITS - r)};
+    if (limbs.size() == 0) {
+        limb_offset = k;
+    }
+    lower_offset(k);
+    k -= limb_offset;
+    if (limbs.size() < k + 2) {
+        limbs.resize(k + 2, 0);
+    }
+    std::size_t n = limbs.size() - k;
+    if ((sign < 0) == negative) {
+        limb_t carry = add(limbs.data() + k, limbs.data() + k, n, addend, 2);
+        if (carry != 0) {
+            limbs.push_back(carry);
+        }
+    } else if (compare(limbs.data() + k, n, addend, 2) >= 0) {
+        sub(limbs.data() + k, limbs.data() + k, n, addend, 2);
+    } else {
+        // the magnitude is below the addend, so it ends at k + 2 limbs: negate it and add
+        for (limb_t& limb : limbs) {
+            limb = ~limb;
+        }
+        limb_t one = 1;
+        add(limbs.data(), limbs.data(), k + 2, &one, 1);
+        add(limbs.data() + k, limbs.data() + k, 2, addend, 2);
+        sign = -sign;
+    }
+    fix_invariants();
+    return *this;
+}
+
+// whole limbs only move the offset, the remaining bits are shifted within the limbs
 LongNum& LongNum::operator<<=(int n) {
-    // fixme: used inefficiently with a copy in many places
-    // maybe fix with "shifted" no-copy views?
-    // or restricting binary_point to 32-multiples
-    // though doesn't matter with a fixed precision
     verify_invariants();
     if (n == 0) {
         return *this;
@@ -238,11 +1628,11 @@ LongNum& LongNum::operator<<=(int n) {
         *this >>= -n;
         return *this;
     }
-    int r = n % 32;
+    int r = n % LIMB_BITS;
     if (r != 0) {
-        uint32_t carry = 0;
+        limb_t carry = 0;
         for (int i = 0; i < (int)limbs.size(); i++) {
-            uint32_t new_carry = limbs[i] >> (32 - r);
+            limb_t new_carry = limbs[i] >> (LIMB_BITS - r);
             limbs[i] <<= r;
             limbs[i] |= carry;
             carry = new_carry;
@@ -251,13 +1641,10 @@ LongNum& LongNum::operator<<=(int n) {
             limbs.emplace_back(carry);
         }
     }
-    int d = n / 32;
-    // fixme: slower but c++23 insert_range is not available for some reason
-    for (int i = 0; i < d; i++) {
-        limbs.emplace(limbs.begin(), 0);
+    if (limbs.size() > 0) {
+        limb_offset += n / LIMB_BITS;
     }
     fix_invariants();
-    verify_invariants();
     return *this;
 }
 
@@ -276,13 +1663,26 @@ LongNum& LongNum::operator>>=(int n) {
         *this <<= -n;
         return *this;
     }
-    int d = std::min(n / 32, (int)limbs.size());
-    limbs.erase(limbs.begin(), limbs.begin() + d);
-    int r = n % 32;
-    if (r != 0) {
-        uint32_t carry = 0;
+    std::size_t d = n / LIMB_BITS;
+    if (d <= limb_offset) {
+        limb_offset -= d;
+    } else {
+        d = std::min(d - limb_offset, limbs.size());
+        limbs.erase(limbs.cbegin(), limbs.cbegin() + d);
+        limb_offset = 0;
+    }
+    int r = n % LIMB_BITS;
+    if (r != 0 && limb_offset > 0 && limbs.size() > 0) {
+        // the bits shifted out of the bottom limb stay in the implicit one below it
+        limb_t carry = lshift(limbs.data(), limbs.data(), limbs.size(), LIMB_BITS - r);
+        if (carry != 0) {
+            limbs.push_back(carry);
+        }
+        limb_offset--;
+    } else if (r != 0) {
+        limb_t carry = 0;
         for (int i = limbs.size() - 1; i >= 0; i--) {
-            uint32_t new_carry = limbs[i] << (32 - r);
+            limb_t new_carry = limbs[i] << (LIMB_BITS - r);
             limbs[i] >>= r;
             limbs[i] |= carry;
             carry = new_carry;
@@ -299,42 +1699,160 @@ LongNum operator>>(LongNum lhs, int n) {
     return lhs;
 }
 
-LongNum operator*(LongNum lhs, const LongNum& rhs) {
-    lhs.verify_invariants();
-    rhs.verify_invariants();
-    LongNum result;
-    result.limbs.resize(lhs.limbs.size() + rhs.limbs.size(), 0);
-    for (int i = 0; i < (int)rhs.limbs.size(); i++) {
-        for (int j = 0; j < (int)lhs.limbs.size(); j++) {
-            uint64_t limb_result = (uint64_t)result.limbs[i + j] + (uint64_t)lhs.limbs[j] * (uint64_t)rhs.limbs[i];
-            result.limbs[i + j] = limb_result;
-            int carry = 0;
-            add_limbs(result.limbs[i + j + 1], limb_result >> 32, carry);
-            for (int k = i + j + 2; k < (int)result.limbs.size(); k++) {
-                add_limbs(result.limbs[k], 0, carry);
-            }
-        }
+// result = lhs * rhs written over the limbs of result, which must not be an operand
+void LongNum::multiply(LongNum& result, const LongNum& lhs, const LongNum& rhs) {
+    result.sign = 1;
+    result.limbs.clear();
+    const LimbVector& lhs_limbs = lhs.limbs;
+    // equal operands (x * x, x *= x, the squarings in pow) go to the squaring kernels
+    const limb_t* rhs_limbs = lhs_limbs == rhs.limbs ? lhs_limbs.data() : rhs.limbs.data();
+    // the implicit zero limbs of the operands are those of the product
+    result.limb_offset = lhs.limb_offset + rhs.limb_offset;
+    // set_precision below drops the lowest `dropped` bits, try not to compute those of them that are stored
+    std::size_t dropped = std::min(lhs.binary_point, rhs.binary_point);
+    std::size_t dropped_stored = dropped > result.limb_offset * LIMB_BITS ? dropped - result.limb_offset * LIMB_BITS : 0;
+    result.binary_point = lhs.binary_point + rhs.binary_point;
+    if (mul_short(result.limbs, lhs_limbs.data(), lhs_limbs.size(), rhs_limbs, rhs.limbs.size(), dropped_stored)) {
+        result.binary_point -= dropped_stored / LIMB_BITS * LIMB_BITS;
+    } else {
+        result.limbs.resize(lhs_limbs.size() + rhs.limbs.size(), 0);
+        // picks schoolbook, Karatsuba, Toom-3 or NTT by the operand sizes
+        mul_limbs(result.limbs.data(), lhs_limbs.data(), lhs_limbs.size(), rhs_limbs, rhs.limbs.size());
     }
     result.fix_invariants();
     if (result.limbs.size() != 0) {
         result.sign = lhs.sign * rhs.sign;
     }
-    result.binary_point = lhs.binary_point + rhs.binary_point;
     result.set_precision(std::max(lhs.binary_point, rhs.binary_point));
+}
+
+LongNum operator*(LongNum lhs, const LongNum& rhs) {
     lhs.verify_invariants();
     rhs.verify_invariants();
-    return result;
+    if (lhs.limbs.size() + rhs.limbs.size() <= LimbVector::INLINE_LIMBS) {
+        // no buffer to reuse, written straight into the result
+        LongNum result(lhs.get_allocator());
+        LongNum::multiply(result, lhs, rhs);
+        return result;
+    }
+    lhs *= rhs;
+    lhs.verify_invariants();
+    rhs.verify_invariants();
+    return lhs;
+}
+
+LongNum operator*(const LongNum& lhs, LongNum&& rhs) {
+    if (!can_reuse_rhs(lhs, rhs)) {
+        return LongNum(lhs) * rhs;
+    }
+    // the product is the same either way round
+    rhs *= lhs;
+    return std::move(rhs);
+}
+
+// holds the products of *= and the fused multiply-adds, its limbs are kept between them;
+// they come from new_delete_resource, the default resource at first use may not live as long as the thread
+static std::optional<LongNum>& product_storage() {
+    thread_local std::optional<LongNum> product;
+    return product;
+}
+
+static LongNum& product_buffer() {
+    std::optional<LongNum>& product = product_storage();
+    if (!product) {
+        product.emplace(LongNum::allocator_type(std::pmr::new_delete_resource()));
+    }
+    return *product;
+}
+
+LongNum& LongNum::multiply_add(const LongNum& lhs, const LongNum& rhs, bool subtract) {
+    verify_invariants();
+    lhs.verify_invariants();
+    rhs.verify_invariants();
+    LongNum& product = product_buffer();
+    // the product is complete before this is written, so this may be one of the operands
+    multiply(product, lhs, rhs);
+    if (binary_point < product.binary_point) {
+        set_precision(product.binary_point);
+    }
+    add_signed(product, subtract ? -product.sign : product.sign);
+    verify_invariants();
+    return *this;
+}
+
+LongNum& LongNum::add_product(const LongNum& lhs, const LongNum& rhs) {
+    return multiply_add(lhs, rhs, false);
+}
+
+LongNum& LongNum::sub_product(const LongNum& lhs, const LongNum& rhs) {
+    return multiply_add(lhs, rhs, true);
+}
+
+LongNum& LongNum::multiply_add_native(const LongNum& lhs, bool negative, limb_t value) {
+    verify_invariants();
+    lhs.verify_invariants();
+    LongNum& product = product_buffer();
+    // copied into the limbs already there rather than shared, so that multiplying them doesn't allocate
+    product.sign = lhs.sign;
+    product.binary_point = lhs.binary_point;
+    product.limb_offset = lhs.limb_offset;
+    const LimbVector& lhs_limbs = lhs.limbs;
+    product.limbs.assign(lhs_limbs.cbegin(), lhs_limbs.cend());
+    product.multiply_native(negative, value);
+    if (binary_point < product.binary_point) {
+        set_precision(product.binary_point);
+    }
+    add_signed(product, product.sign);
+    verify_invariants();
+    return *this;
 }
 
 LongNum& LongNum::operator*=(const LongNum& rhs) {
     verify_invariants();
     rhs.verify_invariants();
-    *this = *this * rhs;
+    if (limbs.size() + rhs.limbs.size() <= LimbVector::INLINE_LIMBS) {
+        // the product fits inline, the buffer gains nothing there
+        LongNum result(get_allocator());
+        multiply(result, *this, rhs);
+        *this = std::move(result);
+        verify_invariants();
+        return *this;
+    }
+    LongNum& product = product_buffer();
+    multiply(product, *this, rhs);
+    sign = product.sign;
+    binary_point = product.binary_point;
+    limb_offset = product.limb_offset;
+    if (*limbs.get_resource() == *product.limbs.get_resource()) {
+        // the old limbs are kept for the next product, unless other copies still use them
+        std::swap(limbs, product.limbs);
+        if (product.limbs.is_shared()) {
+            product_storage().reset();
+        }
+    } else {
+        limbs.assign(product.limbs.cbegin(), product.limbs.cend());
+    }
     verify_invariants();
     rhs.verify_invariants();
     return *this;
 }
 
+LongNum& LongNum::multiply_native(bool negative, limb_t value) {
+    verify_invariants();
+    set_precision(std::max(binary_point, (unsigned int)DEFAULT_PRECISION));
+    if (limbs.size() > 0) {
+        limb_t carry = mul_1(limbs.data(), limbs.data(), limbs.size(), value);
+        if (carry != 0) {
+            limbs.push_back(carry);
+        }
+    }
+    if (negative) {
+        sign = -sign;
+    }
+    fix_invariants();
+    return *this;
+}
+
 LongNum& LongNum::operator/=(const LongNum& rhs) {
     verify_invariants();
     rhs.verify_invariants();
@@ -344,45 +1862,84 @@ LongNum& LongNum::operator/=(const LongNum& rhs) {
     if (*this == 0) {
         return *this;
     }
-    if (binary_point > rhs.binary_point) {
-        LongNum new_rhs = rhs;
-        new_rhs.set_precision(binary_point);
-        *this /= new_rhs;
+    if (&rhs == this) {
+        // the quotient is written over the limbs, keep the divisor in a copy
+        return *this /= LongNum(rhs);
+    }
+    // the stored limbs are divided, the difference of the offsets goes into the shift of the dividend,
+    // or into one of the divisor if it's negative
+    long long shift = division_shift(rhs) + ((long long)limb_offset - (long long)rhs.limb_offset) * LIMB_BITS;
+    std::size_t u_shift = std::max(shift, 0ll), d_shift = std::max(-shift, 0ll);
+    std::size_t un = limbs.size() + u_shift / LIMB_BITS + 1, dn = rhs.limbs.size();
+    Scratch u(un), v(d_shift > 0 ? dn + d_shift / LIMB_BITS + 1 : 0);
+    shift_into(u.data(), std::as_const(limbs).data(), limbs.size(), u_shift);
+    const limb_t* d = rhs.limbs.data();
+    if (d_shift > 0) {
+        shift_into(v.data(), d, dn, d_shift);
+        d = v.data();
+        dn = normalized_size(v.data(), v.size());
+    }
+    // the quotient goes into the old buffer when it's not shared and big enough
+    limbs.clear();
+    limb_offset = 0;
+    if (un >= dn) {
+        limbs.resize(un - dn + 1);
+        divrem(limbs.data(), u.data(), un, d, dn);
+    }
+    binary_point = std::max(binary_point, rhs.binary_point);
+    sign *= rhs.sign;
+    fix_invariants();
+    rhs.verify_invariants();
+    return *this;
+}
+
+// |this| / |rhs| truncated to the result precision is an integer division
+// of |this| * 2^(precision + rhs.binary_point - binary_point) by |rhs|, this returns the shift of the dividend
+unsigned int LongNum::division_shift(const LongNum& rhs) const {
+    unsigned int precision = std::max(binary_point, rhs.binary_point);
+    return precision + rhs.binary_point - binary_point;
+}
+
+LongNum& LongNum::operator/=(const LongNumDivisor& rhs) {
+    verify_invariants();
+    const LongNum& divisor = rhs.divisor;
+    if (*this == 0) {
         return *this;
     }
-    int result_sign = sign * rhs.sign;
-    if (sign != rhs.sign) {
-        *this = -*this;
-    }
-    
-    LongNum result;
-    result.set_precision(std::max(binary_point, rhs.binary_point));
-    while (*this != 0) {
-        int shift = bit_length() - rhs.bit_length();
-        if (shift < -(int)result.binary_point) {
-            break;
-        }
-        LongNum shifted = rhs << shift;
-        if (((*this > shifted) ^ (sign < 0)) || (*this == shifted)) {
-            *this -= shifted;
-            result.set_bit(shift);
-        } else {
-            if (shift <= -(int)result.binary_point) {
-                break;
-            }
-            shifted >>= 1;
-            *this -= shifted;
-            result.set_bit(shift - 1);
-        }
-    }
-    result.sign = result_sign;
-    result.fix_invariants();
-    *this = result;
-    verify_invariants();
-    rhs.verify_invariants();
+    // the divisor has no offset
+    std::size_t shift = division_shift(divisor) + limb_offset * LIMB_BITS;
+    std::size_t un = limbs.size() + shift / LIMB_BITS + 1, dn = divisor.limbs.size();
+    Scratch u(un);
+    shift_into(u.data(), std::as_const(limbs).data(), limbs.size(), shift);
+    limbs.clear();
+    limb_offset = 0;
+    if (un >= dn) {
+        limbs.resize(un - dn + 1);
+        divrem_prepared(limbs.data(), u.data(), un, divisor.limbs.data(), dn, rhs.normalized, rhs.shift, rhs.reciprocal);
+    }
+    binary_point = std::max(binary_point, divisor.binary_point);
+    sign *= divisor.sign;
+    fix_invariants();
     return *this;
 }
 
+LongNum operator/(LongNum lhs, const LongNumDivisor& rhs) {
+    lhs /= rhs;
+    return lhs;
+}
+
+LongNumDivisor::LongNumDivisor(LongNum _divisor) : divisor(std::move(_divisor)) {
+    if (divisor == 0) {
+        throw std::invalid_argument("Division by zero.");
+    }
+    divisor.lower_offset(0);
+    prepare_divisor(divisor.limbs.data(), divisor.limbs.size(), normalized, shift, reciprocal);
+}
+
+const LongNum& LongNumDivisor::value() const {
+    return divisor;
+}
+
 LongNum operator/(LongNum lhs, const LongNum& rhs) {
     lhs.verify_invariants();
     rhs.verify_invariants();
@@ -392,15 +1949,58 @@ LongNum operator/(LongNum lhs, const LongNum& rhs) {
     return lhs;
 }
 
+LongNum& LongNum::divide_native(bool negative, limb_t divisor) {
+    if (divisor == 0) {
+        throw std::invalid_argument("Division by zero.");
+    }
+    set_precision(std::max(binary_point, (unsigned int)DEFAULT_PRECISION));
+    divide_by(divisor);
+    if (negative) {
+        sign = -sign;
+    }
+    fix_invariants();
+    return *this;
+}
+
+LongNum& LongNum::divide_by(limb_t divisor) {
+    if (divisor == 0) {
+        throw std::invalid_argument("Division by zero.");
+    }
+    if (limbs.size() > 0) {
+        // the remainders continue into the implicit limbs
+        lower_offset(0);
+        divrem_1(limbs.data(), limbs.size(), divisor);
+        fix_invariants();
+    }
+    return *this;
+}
+
+limb_t LongNum::divmod_small(limb_t divisor) {
+    if (divisor == 0) {
+        throw std::invalid_argument("Division by zero.");
+    }
+    // shifting within the capacity of the limbs doesn't allocate
+    unsigned int precision = binary_point;
+    set_precision(0);
+    limb_t remainder = 0;
+    if (limbs.size() > 0) {
+        lower_offset(0);
+        remainder = divrem_1(limbs.data(), limbs.size(), divisor);
+        fix_invariants();
+    }
+    set_precision(precision);
+    return remainder;
+}
+
 bool LongNum::get_bit(int pos) const {
     verify_invariants();
     pos += binary_point;
     if (pos < 0) {
         throw std::invalid_argument("Trying to get a bit out of bounds");
     }
-    unsigned int d = pos / 32;
-    unsigned int r = pos % 32;
-    bool result = (limbs[d] >> r) & 1;
+    unsigned int d = pos / LIMB_BITS;
+    unsigned int r = pos % LIMB_BITS;
+    bool result = (limb_at(d) >> r) & 1;
     verify_invariants();
     return result;
 }
@@ -411,10 +2011,15 @@ void LongNum::set_bit(int pos) {
     if (pos < 0) {
         throw std::invalid_argument("Trying to get a bit out of bounds");
     }
-    unsigned int d = pos / 32;
-    unsigned int r = pos % 32;
-    limbs.resize(std::max((unsigned int)limbs.size(), d + 1), 0);
-    limbs[d] |= 1 << r;
+    std::size_t d = pos / LIMB_BITS;
+    unsigned int r = pos % LIMB_BITS;
+    if (limbs.size() == 0) {
+        limb_offset = d;
+    }
+    lower_offset(d);
+    d -= limb_offset;
+    limbs.resize(std::max(limbs.size(), d + 1), 0);
+    limbs[d] |= (limb_t)1 << r;
     verify_invariants();
 }
 
@@ -424,10 +2029,10 @@ void LongNum::unset_bit(int pos) {
     if (pos < 0) {
         throw std::invalid_argument("Trying to get a bit out of bounds");
     }
-    unsigned int d = pos / 32;
-    if (d < limbs.size()) {
-        unsigned int r = pos % 32;
-        limbs[d] &= ~((uint32_t)1 << r);
+    std::size_t d = pos / LIMB_BITS;
+    if (d >= limb_offset && d - limb_offset < limbs.size()) {
+        unsigned int r = pos % LIMB_BITS;
+        limbs[d - limb_offset] &= ~((limb_t)1 << r);
     }
     fix_invariants();
 }
@@ -437,12 +2042,13 @@ int LongNum::bit_length() const {
     if (limbs.size() == 0) {
         return -(int)binary_point;
     }
-    return ((int)limbs.size() - 1) * 32 + (32 - std::countl_zero(limbs.back())) - binary_point;
+    return ((int)(limbs.size() + limb_offset) - 1) * LIMB_BITS + (LIMB_BITS - std::countl_zero(limbs.back())) - binary_point;
 }
 
 LongNum LongNum::pow(int e) const {
     LongNum base = *this;
-    LongNum result = 1;
+    LongNum result(1, get_allocator());
+    result.set_precision(binary_point);
     while (e != 0) {
         if (e & 1) {
             result *= base;
@@ -476,205 +2082,616 @@ LongNum LongNum::round() const {
 }
 
 int LongNum::to_int() const {
-    int d = binary_point / 32;
-    int r = binary_point % 32;
-    uint32_t result = 0;
-    if (d < (int)limbs.size()) {
-        result |= limbs[d] >> r;
-    }
-    if (d + 1 < (int)limbs.size() && r != 0) {
-        result |= limbs[d + 1] << (32 - r);
+    int d = binary_point / LIMB_BITS;
+    int r = binary_point % LIMB_BITS;
+    limb_t result = limb_at(d) >> r;
+    if (r != 0) {
+        result |= limb_at(d + 1) << (LIMB_BITS - r);
     }
     result &= 0x7FFFFFFF;
     return sign * (int) result;
 }
 
-// simpler specialization for binary
 std::string LongNum::to_binary_string() const {
-    verify_invariants();
-    std::string result;
-    for (int i = 0; i < (int)limbs.size(); i++) {
-        uint64_t x = limbs[i];
-        for (int j = 0; j < 32; j++) {
-            if (x == 0 && i == (int)limbs.size() - 1) {
-                break;
+    return to_string(2);
+}
+
+LongNum LongNum::from_binary_string(const std::string& number) {
+    return from_string(number, 2);
+}
+
+// powers of a base for radix conversion: power[i] = base^digits[i] with digits[i] = chunk * 2^i,
+// where base^chunk is the largest power of the base within a limb; for division by the powers
+// they are prepared separately, as parsing only multiplies by them
+struct RadixPowers {
+    unsigned int base;
+    std::size_t chunk = 0;
+    limb_t chunk_power = 1;
+    std::vector<std::vector<limb_t>> power;
+    std::vector<std::size_t> digits;
+    std::vector<std::vector<limb_t>> normalized;
+    std::vector<int> shift;
+    std::vector<std::vector<limb_t>> reciprocal;
+    // base^fraction_digits that the last parsed number with a fraction was divided by, prepared
+    // for division, so numbers with as many fraction digits only divide
+    std::size_t fraction_digits = 0;
+    std::vector<limb_t> fraction_power;
+    std::vector<limb_t> fraction_normalized;
+    int fraction_shift = 0;
+    std::vector<limb_t> fraction_reciprocal;
+    // base^scale_digits that the fraction of the last printed number was multiplied by
+    std::size_t scale_digits = 0;
+    std::vector<limb_t> scale_power = {1};
+
+    RadixPowers(unsigned int _base) : base(_base) {
+        while (chunk_power <= std::numeric_limits<limb_t>::max() / base) {
+            chunk_power *= base;
+            chunk++;
+        }
+        power.push_back({chunk_power});
+        digits.push_back(chunk);
+    }
+
+    // enough powers to split numbers of up to n limbs
+    void extend(std::size_t n) {
+        while (power.back().size() * 2 <= n) {
+            const std::vector<limb_t>& last = power.back();
+            std::vector<limb_t> square(2 * last.size());
+            mul_limbs(square.data(), last.data(), last.size(), last.data(), last.size());
+            square.resize(normalized_size(square.data(), square.size()));
+            power.push_back(std::move(square));
+            digits.push_back(digits.back() * 2);
+        }
+    }
+
+    void prepare() {
+        for (std::size_t i = normalized.size(); i < power.size(); i++) {
+            normalized.emplace_back();
+            shift.push_back(0);
+            reciprocal.emplace_back();
+            prepare_divisor(power[i].data(), power[i].size(), normalized[i], shift[i], reciprocal[i]);
+        }
+    }
+
+    // result = base^e, multiplied together from the powers of chunk_power
+    void power_of(std::size_t e, std::vector<limb_t>& result) {
+        std::size_t chunks = e / chunk;
+        while (power.size() < (std::size_t)std::bit_width(chunks)) {
+            extend(2 * power.back().size());
+        }
+        limb_t low = 1;
+        for (std::size_t i = 0; i < e % chunk; i++) {
+            low *= base;
+        }
+        result.assign(1, low);
+        for (std::size_t i = 0; i < power.size() && (chunks >> i) != 0; i++) {
+            if ((chunks >> i) & 1) {
+                Scratch product(result.size() + power[i].size());
+                mul_limbs(product.data(), power[i].data(), power[i].size(), result.data(), result.size());
+                result.assign(product.begin(), product.begin() + normalized_size(product.data(), product.size()));
             }
-            if (result.size() == binary_point) {
-                result.push_back('.');
+        }
+    }
+
+    // fraction_power = base^e prepared for division
+    void prepare_fraction(std::size_t e) {
+        if (e == fraction_digits) {
+            return;
+        }
+        power_of(e, fraction_power);
+        fraction_normalized.clear();
+        fraction_reciprocal.clear();
+        prepare_divisor(fraction_power.data(), fraction_power.size(), fraction_normalized, fraction_shift, fraction_reciprocal);
+        fraction_digits = e;
+    }
+
+    // scale_power = base^e
+    void prepare_scale(std::size_t e) {
+        if (e != scale_digits) {
+            power_of(e, scale_power);
+            scale_digits = e;
+        }
+    }
+};
+
+// the powers of each base persist across conversions, growing with the largest number seen
+// by the thread, so converting many numbers in a row computes them only once
+static RadixPowers& radix_powers(unsigned int base) {
+    thread_local std::map<unsigned int, RadixPowers> cache;
+    return cache.try_emplace(base, base).first->second;
+}
+
+const char RADIX_DIGITS[] = "0123456789abcdef";
+
+// the value of a digit character in bases up to 16, or 16 for any other character
+static unsigned int digit_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return 16;
+}
+
+// output into a buffer [first, last): when it fills up it's either handed to flush and reused,
+// or, without flush, whatever doesn't fit is dropped and marks an overflow
+struct CharWriter {
+    char* first;
+    char* pos;
+    char* last;
+    const std::function<void(std::string_view)>* flush = nullptr;
+    bool overflow = false;
+
+    // room for at least one character, false on overflow
+    bool make_room() {
+        if (pos != last) {
+            return true;
+        }
+        if (flush == nullptr) {
+            overflow = true;
+            return false;
+        }
+        (*flush)(std::string_view(first, pos - first));
+        pos = first;
+        return true;
+    }
+
+    void append(const char* s, std::size_t n) {
+        while (n > 0 && make_room()) {
+            std::size_t k = std::min<std::size_t>(n, last - pos);
+            pos = std::copy(s, s + k, pos);
+            s += k;
+            n -= k;
+        }
+    }
+
+    void fill(std::size_t n, char c) {
+        while (n > 0 && make_room()) {
+            std::size_t k = std::min<std::size_t>(n, last - pos);
+            pos = std::fill_n(pos, k, c);
+            n -= k;
+        }
+    }
+
+    void put(char c) {
+        fill(1, c);
+    }
+
+    void finish() {
+        if (flush != nullptr && pos != first) {
+            (*flush)(std::string_view(first, pos - first));
+            pos = first;
+        }
+    }
+};
+
+// writes the digits of a, left-padded with zeros to width; a is destroyed
+// a is split at the power closest to its square root and both halves are converted recursively,
+// small numbers are converted chunk by chunk with single-limb divisions
+static void write_digits(CharWriter& out, limb_t* a, std::size_t an, std::size_t width, const RadixPowers& powers) {
+    an = normalized_size(a, an);
+    if (an < RADIX_DC_THRESHOLD) {
+        char buffer[(RADIX_DC_THRESHOLD + 1) * LIMB_BITS];
+        char* start = std::end(buffer);
+        while (an > 0) {
+            limb_t r = divrem_1(a, an, powers.chunk_power);
+            an = normalized_size(a, an);
+            for (std::size_t j = 0; j < powers.chunk && (an > 0 || r != 0); j++) {
+                *--start = RADIX_DIGITS[r % powers.base];
+                r /= powers.base;
             }
-            result.push_back(x & 1 ? '1' : '0');
-            x >>= 1;
         }
+        std::size_t size = std::end(buffer) - start;
+        if (width > size) {
+            out.fill(width - size, '0');
+        }
+        out.append(start, size);
+        return;
+    }
+    std::size_t i = powers.power.size() - 1;
+    while (powers.power[i].size() * 2 > an + 1) {
+        i--;
     }
-    while (result.size() < binary_point) {
-        result.push_back('0');
+    std::size_t dn = powers.power[i].size();
+    Scratch q(an - dn + 1);
+    divrem_prepared(q.data(), a, an, powers.power[i].data(), dn, powers.normalized[i], powers.shift[i], powers.reciprocal[i]);
+    write_digits(out, q.data(), q.size(), width > powers.digits[i] ? width - powers.digits[i] : 0, powers);
+    if (!out.overflow) {
+        write_digits(out, a, dn, powers.digits[i], powers);
     }
-    if (result.size() == binary_point && binary_point != 0) {
-        result.push_back('.');
-        result.push_back('0');
+}
+
+// the stored limbs shifted up by offset limbs, as a LongNum keeps them
+struct OffsetLimbs {
+    const LimbVector& limbs;
+    std::size_t offset;
+
+    std::size_t size() const {
+        return limbs.size() > 0 ? limbs.size() + offset : 0;
     }
-    if (result.empty()) {
-        result.push_back('0');
+    limb_t operator[](std::size_t i) const {
+        return i >= offset && i - offset < limbs.size() ? limbs[i - offset] : 0;
     }
+};
+
+// simpler specialization for binary: every bit of the whole part and exactly bp bits of the fraction
+static void write_binary(CharWriter& out, int sign, unsigned int bp, OffsetLimbs limbs) {
+    auto bit = [&](std::size_t j) {
+        return (limbs[j / LIMB_BITS] >> (j % LIMB_BITS)) & 1 ? '1' : '0';
+    };
     if (sign < 0) {
-        result.push_back('-');
+        out.put('-');
+    }
+    std::size_t bits = limbs.size() * LIMB_BITS - (limbs.size() > 0 ? std::countl_zero(limbs[limbs.size() - 1]) : 0);
+    if (bits <= bp) {
+        out.put('0');
+    }
+    for (std::size_t j = bits; j-- > bp && !out.overflow;) {
+        out.put(bit(j));
+    }
+    if (bp > 0) {
+        out.put('.');
+    }
+    for (std::size_t j = bp; j-- > 0 && !out.overflow;) {
+        out.put(bit(j));
     }
-    return std::string(result.rbegin(), result.rend());
 }
 
-// simpler specialization for binary 
-LongNum LongNum::from_binary_string(const std::string& number) {
-    const std::string ws = " \t\n\r\f\v";
-    
-    std::size_t i = number.find_first_not_of(ws);
-    if (i == std::string::npos) {
-        return LongNum();
-    }
-    int sign = number[i] == '-' ? -1 : 1;
-    if (number[i] == '+' || number[i] == '-') {
-        i++;
+// limbs that hold any number of len digits in the base, with room for the products read_digits forms
+static std::size_t digits_limbs(unsigned int base, std::size_t len) {
+    return std::ceil(std::log2(base) * len / LIMB_BITS) + 2;
+}
+
+// r = the value of len digits starting from digit number from, in the base of powers; r has
+// digits_limbs(base, len) limbs, the normalized size is returned
+// the digits are in s with a point at s[point] skipped (point is past the end if there's none)
+// the low half is the last digits[i] digits for the power closest to half of the length,
+// so the result is high * power[i] + low; short strings are read chunk by chunk
+static std::size_t read_digits(limb_t* r, const char* s, std::size_t point, std::size_t from, std::size_t len, const RadixPowers& powers) {
+    if (len <= powers.chunk * RADIX_DC_THRESHOLD) {
+        std::size_t rn = 0;
+        std::size_t end = from + (len % powers.chunk == 0 ? powers.chunk : len % powers.chunk);
+        for (std::size_t j = from; j < from + len; end += powers.chunk) {
+            limb_t value = 0, scale = 1;
+            for (; j < end; j++) {
+                value = value * powers.base + digit_value(s[j + (j >= point)]);
+                scale *= powers.base;
+            }
+            r[rn] = mul_1(r, r, rn, scale);
+            rn++;
+            add(r, r, rn, &value, 1);
+            if (r[rn - 1] == 0) {
+                rn--;
+            }
+        }
+        return rn;
+    }
+    std::size_t i = powers.power.size() - 1;
+    while (powers.digits[i] * 2 > len) {
+        i--;
+    }
+    std::size_t low_len = powers.digits[i];
+    std::size_t rn = digits_limbs(powers.base, len);
+    const std::vector<limb_t>& p = powers.power[i];
+    {
+        Scratch high(digits_limbs(powers.base, len - low_len));
+        std::size_t hn = read_digits(high.data(), s, point, from, len - low_len, powers);
+        assert(hn + p.size() <= rn);
+        mul_limbs(r, high.data(), hn, p.data(), p.size());
+        std::fill(r + hn + p.size(), r + rn, 0);
+    }
+    Scratch low(digits_limbs(powers.base, low_len));
+    std::size_t ln = read_digits(low.data(), s, point, from + len - low_len, low_len, powers);
+    add_into(r, rn, low.data(), ln);
+    return normalized_size(r, rn);
+}
+
+// whether a has a set bit at a position >= from
+static bool has_bits_from(const limb_t* a, std::size_t an, std::size_t from) {
+    for (std::size_t i = from / LIMB_BITS; i < an; i++) {
+        limb_t limb = i == from / LIMB_BITS ? a[i] >> (from % LIMB_BITS) : a[i];
+        if (limb != 0) {
+            return true;
+        }
     }
-    int digits_start = i;
-    std::size_t digits_end = number.find_last_not_of(ws);
-    if (digits_end == number.size() - 1) {
-        digits_end = std::string::npos;
-    } else {
-        digits_end += 1;
-    }
-    if (number.find_first_not_of("01.", digits_start) != digits_end) {
-        throw std::invalid_argument(std::format("Invalid binary string: \"{}\"", number));
-    }
-    if (digits_end == std::string::npos) {
-        digits_end = number.size();
-    }
-    std::vector<uint32_t> limbs;
-    std::size_t binary_point = number.find_first_of('.');
-    std::string lnum = number;
-    if (binary_point != std::string::npos) {
-        assert(binary_point < digits_end);
-        lnum.erase(lnum.begin() + binary_point);
-        binary_point = digits_end - 1 - binary_point;
-        digits_end--;
-    } else {
-        binary_point = 0;
+    return false;
+}
+
+// whether a has a set bit at a position < to
+static bool has_bits_below(const limb_t* a, std::size_t an, std::size_t to) {
+    for (std::size_t i = 0; i < an && i * LIMB_BITS < to; i++) {
+        limb_t limb = (i + 1) * LIMB_BITS <= to ? a[i] : a[i] & (((limb_t)1 << (to % LIMB_BITS)) - 1);
+        if (limb != 0) {
+            return true;
+        }
     }
-    if (lnum.find_first_of(".") != std::string::npos) {
-        throw std::invalid_argument(std::format("Invalid binary string: \"{}\"", number));
+    return false;
+}
+
+// digits = the first n digits of the fraction f / 2^bp (0 < f < 2^bp) as an integer, rounded, given
+// scale = base^n; digits has sn + 2 limbs and dn is set to the used ones
+// returns true when the rounding carried into the whole part, the digits are zero then;
+// with n = 0 the digit that a tie rounds to even is the last one of the whole part, whole_odd is its parity
+// only the top n * log2(base) + 64 bits of f are multiplied by base^n, the dropped ones change the result
+// only if the remainder is within base^n of a rounding boundary, and then everything is redone exactly
+static bool fraction_digits(limb_t* digits, std::size_t& dn, const limb_t* f, std::size_t fn, unsigned int bp, unsigned int base,
+                            const limb_t* scale, std::size_t sn, std::size_t n, LongNum::Rounding rounding, bool whole_odd,
+                            bool exact = false) {
+    std::size_t needed = std::ceil(std::log2(base) * n) + LIMB_BITS;
+    std::size_t drop = !exact && bp > needed ? std::min((bp - needed) / LIMB_BITS, fn) : 0;
+    bool sticky = normalized_size(f, drop) != 0;
+    std::size_t p = bp - drop * LIMB_BITS;
+    Scratch product(fn - drop + sn);
+    mul_limbs(product.data(), f + drop, fn - drop, scale, sn);
+    bool half = (p - 1) / LIMB_BITS < product.size() && (product[(p - 1) / LIMB_BITS] >> ((p - 1) % LIMB_BITS) & 1);
+    if (sticky) {
+        Scratch bound(std::max(product.size(), p / LIMB_BITS + 1) + 1);
+        std::copy(product.begin(), product.begin() + std::min(product.size(), p / LIMB_BITS + 1), bound.begin());
+        bound[p / LIMB_BITS] &= ((limb_t)1 << (p % LIMB_BITS)) - 1;
+        add_into(bound.data(), bound.size(), scale, sn);
+        bool by_half = rounding == LongNum::Rounding::HALF_AWAY_FROM_ZERO || rounding == LongNum::Rounding::HALF_EVEN;
+        if (has_bits_from(bound.data(), bound.size(), p) || (by_half && !half && has_bits_from(bound.data(), bound.size(), p - 1))) {
+            return fraction_digits(digits, dn, f, fn, bp, base, scale, sn, n, rounding, whole_odd, true);
+        }
     }
-    for (int i = digits_end - 1; i >= digits_start; i -= 32) {
-        uint32_t limb = 0;
-        for (int j = std::max(digits_start, i - 31); j <= i; j++) {
-            limb <<= 1;
-            limb |= lnum[j] == '1';
+    dn = 0;
+    if (p / LIMB_BITS < product.size()) {
+        dn = product.size() - p / LIMB_BITS;
+        assert(dn <= sn + 1);
+        std::copy(product.begin() + p / LIMB_BITS, product.end(), digits);
+        if (p % LIMB_BITS != 0) {
+            rshift(digits, dn, p % LIMB_BITS);
         }
-        limbs.push_back(limb);
     }
-    LongNum result(sign, binary_point, std::move(limbs));
-    if (binary_point < DEFAULT_PRECISION) {
-        result.set_precision(DEFAULT_PRECISION);
+    bool odd = n == 0 ? whole_odd : dn > 0 && (digits[0] & 1);
+    bool above_half = half && (sticky || has_bits_below(product.data(), product.size(), p - 1));
+    bool increment = false;
+    switch (rounding) {
+    case LongNum::Rounding::TOWARD_ZERO:
+        break;
+    case LongNum::Rounding::AWAY_FROM_ZERO:
+        increment = sticky || has_bits_below(product.data(), product.size(), p);
+        break;
+    case LongNum::Rounding::HALF_AWAY_FROM_ZERO:
+        increment = half;
+        break;
+    case LongNum::Rounding::HALF_EVEN:
+        increment = above_half || (half && odd);
+        break;
+    }
+    if (increment) {
+        limb_t one = 1;
+        digits[dn] = 0;
+        add(digits, digits, dn + 1, &one, 1);
+        dn = normalized_size(digits, dn + 1);
+        if (compare(digits, dn, scale, sn) == 0) {
+            dn = 0;
+            return true;
+        }
     }
-    return result;
+    return false;
 }
 
-std::string LongNum::to_string(unsigned int base) const {
-    if (base == 2) {
-        return to_binary_string();
+// the text of to_string for the number with these sign, binary_point and limbs
+static void write_number(CharWriter& out, int sign, unsigned int binary_point, OffsetLimbs limbs,
+                         unsigned int base, std::size_t max_fraction_digits, LongNum::Rounding rounding) {
+    if (base == 2 && max_fraction_digits == LongNum::ALL_DIGITS) {
+        write_binary(out, sign, binary_point, limbs);
+        return;
     }
     if (base < 2 || base > 16) {
         throw std::invalid_argument("Invalid base under 2 or over 16");
     }
-    const std::string digits = "0123456789abcdef";
-    std::string result;
-    LongNum whole = this->truncate();
-    while (whole != 0) {
-        LongNum d = (whole / base).truncate();
-        int rem = std::abs((whole - d * base).to_int());
-        whole = d;
-        result.push_back(digits[rem]);
+    RadixPowers& powers = radix_powers(base);
+    std::size_t k = binary_point / LIMB_BITS;
+    int r = binary_point % LIMB_BITS;
+    // one more limb for a carry out of the rounding of the fraction
+    std::size_t wn = k < limbs.size() ? limbs.size() - k : 0;
+    Scratch whole(wn + 1);
+    for (std::size_t i = 0; i < wn; i++) {
+        whole[i] = limbs[k + i];
     }
-    if (result.size() == 0) {
-        result.push_back('0');
+    if (r != 0) {
+        rshift(whole.data(), wn, r);
+    }
+    // the fraction f / 2^binary_point has the digits of f * base^n >> binary_point for the right n:
+    // an even base = 2^t * c needs (binary_point - trailing zeros of f) / t of them for an exact result,
+    // an odd one never terminates and is cut after as many digits as the precision covers
+    Scratch frac(std::min(limbs.size(), k + (r != 0)));
+    for (std::size_t i = 0; i < frac.size(); i++) {
+        frac[i] = limbs[i];
+    }
+    if (frac.size() == k + 1) {
+        frac[k] &= ((limb_t)1 << r) - 1;
+    }
+    std::size_t fn = normalized_size(frac.data(), frac.size());
+    std::size_t n = 0;
+    if (fn > 0) {
+        int t = std::countr_zero(base);
+        if (t > 0) {
+            std::size_t zeros = 0;
+            while (frac[zeros / LIMB_BITS] == 0) {
+                zeros += LIMB_BITS;
+            }
+            zeros += std::countr_zero(frac[zeros / LIMB_BITS]);
+            n = (binary_point - zeros + t - 1) / t;
+        } else {
+            n = std::ceil(binary_point / std::log2(base));
+        }
+        if (n > max_fraction_digits) {
+            n = max_fraction_digits;
+        } else {
+            rounding = LongNum::Rounding::TOWARD_ZERO;
+        }
+        powers.prepare_scale(n);
+    }
+    Scratch digits(fn > 0 ? powers.scale_power.size() + 2 : 0);
+    std::size_t dn = 0;
+    if (fn > 0) {
+        // the parity of the last whole digit, (whole mod base) mod 2
+        limb_t last_digit = 0;
+        for (std::size_t i = wn; i-- > 0;) {
+            last_digit = (((dlimb_t)last_digit << LIMB_BITS) | whole[i]) % base;
+        }
+        if (fraction_digits(digits.data(), dn, frac.data(), fn, binary_point, base, powers.scale_power.data(),
+                            powers.scale_power.size(), n, rounding, last_digit & 1)) {
+            limb_t one = 1;
+            add(whole.data(), whole.data(), wn + 1, &one, 1);
+            wn++;
+        }
     }
     if (sign < 0) {
-        result.push_back('-');
+        out.put('-');
+    }
+    powers.extend(std::max(wn, dn));
+    powers.prepare();
+    if (normalized_size(whole.data(), wn) == 0) {
+        out.put('0');
+    } else {
+        write_digits(out, whole.data(), wn, 0, powers);
     }
-    std::reverse(result.begin(), result.end());
-    LongNum frac = this->frac();
-    if (frac != 0) {
-        result.push_back('.');
+    if (n > 0) {
+        out.put('.');
+        write_digits(out, digits.data(), dn, n, powers);
     }
-    while (frac != 0) {
-        frac *= base;
-        int rem = frac.truncate().to_int();
-        result.push_back(digits[std::abs(rem)]);
-        frac -= rem;
+}
+
+std::to_chars_result LongNum::to_chars(char* first, char* last, unsigned int base, std::size_t max_fraction_digits, Rounding rounding) const {
+    CharWriter out{first, first, last};
+    write_number(out, sign, binary_point, {limbs, limb_offset}, base, max_fraction_digits, rounding);
+    return out.overflow ? std::to_chars_result{last, std::errc::value_too_large} : std::to_chars_result{out.pos, std::errc()};
+}
+
+void LongNum::print(const std::function<void(std::string_view)>& sink, unsigned int base, std::size_t max_fraction_digits, Rounding rounding) const {
+    std::size_t size = std::min(PRINT_CHUNK, to_chars_size(base, max_fraction_digits));
+    // the characters are kept in limbs of the scratch stack
+    Scratch buffer((size + sizeof(limb_t) - 1) / sizeof(limb_t));
+    char* first = reinterpret_cast<char*>(buffer.data());
+    CharWriter out{first, first, first + size, &sink};
+    write_number(out, sign, binary_point, {limbs, limb_offset}, base, max_fraction_digits, rounding);
+    out.finish();
+}
+
+void LongNum::print(std::ostream& stream, unsigned int base, std::size_t max_fraction_digits, Rounding rounding) const {
+    print([&stream](std::string_view chunk) { stream.write(chunk.data(), chunk.size()); }, base, max_fraction_digits, rounding);
+}
+
+std::size_t LongNum::to_chars_size(unsigned int base, std::size_t max_fraction_digits) const {
+    if (base < 2 || base > 16) {
+        throw std::invalid_argument("Invalid base under 2 or over 16");
     }
+    std::size_t bits = limbs.size() > 0 ? (limbs.size() + limb_offset) * LIMB_BITS - std::countl_zero(limbs.back()) : 0;
+    std::size_t whole_bits = bits > binary_point ? bits - binary_point : 0;
+    if (base == 2 && max_fraction_digits == ALL_DIGITS) {
+        return 1 + std::max<std::size_t>(whole_bits, 1) + (binary_point > 0 ? 1 + binary_point : 0);
+    }
+    double digit_bits = std::log2(base);
+    int t = std::countr_zero(base);
+    std::size_t fraction_digits = t > 0 ? (binary_point + t - 1) / t : std::ceil(binary_point / digit_bits);
+    fraction_digits = std::min(fraction_digits, max_fraction_digits);
+    // one more whole digit for a carry out of the rounding and one for the floating point error
+    std::size_t whole_digits = whole_bits / digit_bits + 2;
+    return 1 + whole_digits + (fraction_digits > 0 ? 1 + fraction_digits : 0);
+}
+
+std::string LongNum::to_string(unsigned int base, std::size_t max_fraction_digits, Rounding rounding) const {
+    std::string result(to_chars_size(base, max_fraction_digits), '\0');
+    std::to_chars_result end = to_chars(result.data(), result.data() + result.size(), base, max_fraction_digits, rounding);
+    assert(end.ec == std::errc());
+    result.resize(end.ptr - result.data());
     return result;
 }
 
-LongNum LongNum::from_string(const std::string& number, unsigned int base) {
-    if (base == 2) {
-        return LongNum::from_binary_string(number);
+
+std::from_chars_result LongNum::from_chars(const char* first, const char* last, LongNum& value, unsigned int base) {
+    if (base < 2 || base > 16) {
+        throw std::invalid_argument("Invalid base under 2 or over 16");
+    }
+    const char* p = first;
+    bool negative = p != last && *p == '-';
+    if (negative) {
+        p++;
+    }
+    const char* digits_start = p;
+    while (p != last && digit_value(*p) < base) {
+        p++;
+    }
+    std::size_t point = p - digits_start, fraction = 0;
+    if (p != last && *p == '.') {
+        p++;
+        while (p != last && digit_value(*p) < base) {
+            p++;
+            fraction++;
+        }
+    }
+    std::size_t len = point + fraction;
+    if (len == 0) {
+        return {first, std::errc::invalid_argument};
+    }
+    // the digits read as an integer n give n / base^fraction, the binary point is placed at the precision
+    // that covers the fractional digits and the value is truncated toward zero as in a division
+    RadixPowers& powers = radix_powers(base);
+    powers.extend(std::ceil(std::log2(base) * len / LIMB_BITS) + 1);
+    unsigned int precision = std::ceil(std::log2(base) * fraction);
+    // the quotient goes into the limbs of value, which are reused when not shared and big enough
+    LimbVector& q = value.limbs;
+    q.clear();
+    if (fraction == 0) {
+        q.resize(digits_limbs(base, len));
+        q.resize(read_digits(q.data(), digits_start, point, 0, len, powers));
+    } else {
+        Scratch n(digits_limbs(base, len));
+        std::size_t nn = read_digits(n.data(), digits_start, point, 0, len, powers);
+        Scratch u(nn + precision / LIMB_BITS + 1);
+        shift_into(u.data(), n.data(), nn, precision);
+        powers.prepare_fraction(fraction);
+        const std::vector<limb_t>& d = powers.fraction_power;
+        std::size_t un = normalized_size(u.data(), u.size()), dn = d.size();
+        if (un >= dn) {
+            q.resize(un - dn + 1);
+            divrem_prepared(q.data(), u.data(), un, d.data(), dn, powers.fraction_normalized, powers.fraction_shift, powers.fraction_reciprocal);
+        }
     }
+    value.sign = negative ? -1 : 1;
+    value.binary_point = precision;
+    value.limb_offset = 0;
+    value.fix_invariants();
+    // binary strings always kept at least the default precision
+    if (base == 2 && precision < DEFAULT_PRECISION) {
+        value.set_precision(DEFAULT_PRECISION);
+    }
+    return {p, std::errc()};
+}
+
+LongNum LongNum::from_string(const std::string& number, unsigned int base) {
     if (base < 2 || base > 16) {
         throw std::invalid_argument("Invalid base under 2 or over 16");
     }
-    std::string lnum = number; 
-    std::transform(lnum.begin(), lnum.end(), lnum.begin(),
-        [](unsigned char c){ return std::tolower(c); });
     const std::string ws = " \t\n\r\f\v";
-    std::string digits = "0123456789abcdef";
-    digits = digits.substr(0, base);
-    
-    std::size_t i = lnum.find_first_not_of(ws);
+    std::size_t i = number.find_first_not_of(ws);
     if (i == std::string::npos) {
         return LongNum();
     }
-    int sign = lnum[i] == '-' ? -1 : 1;
-    if (lnum[i] == '+' || lnum[i] == '-') {
+    bool negative = number[i] == '-';
+    if (number[i] == '+' || number[i] == '-') {
         i++;
     }
-    int digits_start = i;
-    std::size_t digits_end = lnum.find_last_not_of(ws);
-    if (digits_end == lnum.size() - 1) {
-        digits_end = std::string::npos;
-    } else {
-        digits_end += 1;
-    }
-    if (lnum.find_first_not_of(digits + ".", digits_start) != digits_end) {
-        throw std::invalid_argument(std::format("Invalid number string: \"{}\"", number));
-    }
-    if (digits_end == std::string::npos) {
-        digits_end = lnum.size();
-    }
-    std::size_t point = number.find_first_of('.');
-    if (point != std::string::npos) {
-        assert(point < digits_end);
-        lnum.erase(lnum.begin() + point);
-        point = digits_end - 1 - point;
-        digits_end--;
-    } else {
-        point = 0;
-    }
-    if (lnum.find_first_of(".") != std::string::npos) {
-        throw std::invalid_argument(std::format("Invalid binary string: \"{}\"", number));
+    std::size_t end = number.find_last_not_of(ws) + 1;
+    if (i == end) {
+        return LongNum();
     }
     LongNum result;
-    for (int i = digits_start; i < (int)digits_end; i++) {
-        std::size_t idx = digits.find_first_of(lnum[i]);
-        assert(idx != std::string::npos);
-        LongNum d = idx;
-        result *= base;
-        result += d;
+    std::from_chars_result parsed = from_chars(number.data() + i, number.data() + end, result, base);
+    if (number[i] == '-' || parsed.ec != std::errc() || parsed.ptr != number.data() + end) {
+        throw std::invalid_argument(std::format("Invalid number string: \"{}\"", number));
     }
-
-    unsigned int precision = std::ceil(std::log2(base) * point);
-    result.set_precision(precision);
-    result /= LongNum(base).with_precision(precision).pow(point);
-    if (result != 0) {
-        result.sign = sign;
+    if (negative && result.limbs.size() > 0) {
+        result.sign = -1;
     }
-
     result.verify_invariants();
     return result;
 }
@@ -694,8 +2711,203 @@ LongNum LongNum::with_precision(unsigned int precision) const {
     return result;
 }
 
+std::size_t LongNum::scratch_high_water() {
+    return scratch_stack().high_water * sizeof(limb_t);
+}
+
+void LongNum::trim_scratch() {
+    scratch_stack().trim();
+    product_storage().reset();
+}
+
+const char SERIAL_MAGIC[4] = {'L', 'N', 'U', 'M'};
+const uint16_t SERIAL_VERSION = 1;
+const std::size_t SERIAL_HEADER_SIZE = 24;
+
+static void store_le(unsigned char* p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+// checks a serialized header and returns the limb count
+static uint64_t read_serial_header(const unsigned char* header, int& sign, unsigned int& binary_point) {
+    if (std::memcmp(header, SERIAL_MAGIC, sizeof(SERIAL_MAGIC)) != 0) {
+        throw std::invalid_argument("Not a serialized LongNum");
+    }
+    uint16_t version = load_le(header + 4, 2);
+    if (version != SERIAL_VERSION) {
+        throw std::invalid_argument(std::format("Unsupported serialized LongNum version {}", version));
+    }
+    sign = load_le(header + 6, 2) & 1 ? -1 : 1;
+    binary_point = load_le(header + 8, 4);
+    return load_le(header + 16, 8);
+}
+
+// the limbs must satisfy the invariants, as they are taken as they are
+static void check_serial_limbs(int sign, const limb_t* limbs, std::size_t n) {
+    if (n > 0 ? limbs[n - 1] == 0 : sign < 0) {
+        throw std::invalid_argument("Corrupted serialized LongNum");
+    }
+}
+
+void LongNum::serialize(std::ostream& stream) const {
+    verify_invariants();
+    unsigned char header[SERIAL_HEADER_SIZE] = {};
+    std::memcpy(header, SERIAL_MAGIC, sizeof(SERIAL_MAGIC));
+    store_le(header + 4, SERIAL_VERSION, 2);
+    store_le(header + 6, sign < 0, 2);
+    store_le(header + 8, binary_point, 4);
+    // the implicit limbs are written out, so the format doesn't depend on them
+    store_le(header + 16, limbs.size() > 0 ? limbs.size() + limb_offset : 0, 8);
+    stream.write((const char*)header, sizeof(header));
+    const limb_t zero = 0;
+    for (std::size_t i = 0; i < limb_offset; i++) {
+        stream.write((const char*)&zero, sizeof(zero));
+    }
+    if constexpr (std::endian::native == std::endian::little) {
+        stream.write((const char*)limbs.data(), limbs.size() * sizeof(limb_t));
+    } else {
+        for (limb_t limb : limbs) {
+            unsigned char bytes[sizeof(limb_t)];
+            store_le(bytes, limb, sizeof(limb_t));
+            stream.write((const char*)bytes, sizeof(bytes));
+        }
+    }
+}
+
+LongNum LongNum::deserialize(std::istream& stream, const allocator_type& alloc) {
+    unsigned char header[SERIAL_HEADER_SIZE];
+    if (!stream.read((char*)header, sizeof(header))) {
+        throw std::invalid_argument("Truncated serialized LongNum");
+    }
+    LongNum result(alloc);
+    uint64_t n = read_serial_header(header, result.sign, result.binary_point);
+    // read in blocks so a corrupted count fails at the end of the stream rather than allocating it all
+    const uint64_t block = 1 << 16;
+    for (uint64_t done = 0; done < n;) {
+        std::size_t count = std::min(block, n - done);
+        result.limbs.resize(done + count);
+        if (!stream.read((char*)(result.limbs.data() + done), count * sizeof(limb_t))) {
+            throw std::invalid_argument("Truncated serialized LongNum");
+        }
+        if constexpr (std::endian::native != std::endian::little) {
+            for (std::size_t i = done; i < done + count; i++) {
+                result.limbs[i] = load_le((const unsigned char*)&result.limbs[i], sizeof(limb_t));
+            }
+        }
+        done += count;
+    }
+    check_serial_limbs(result.sign, result.limbs.data(), result.limbs.size());
+    result.verify_invariants();
+    return result;
+}
+
+struct MappedFile : LimbVector::Lender {
+    void* mapping;
+    std::size_t size;
+
+    MappedFile(void* _mapping, std::size_t _size) : mapping(_mapping), size(_size) {}
+    ~MappedFile() override {
+        munmap(mapping, size);
+    }
+};
+
+LongNumMapping::LongNumMapping(const std::string& path) {
+    if constexpr (std::endian::native != std::endian::little) {
+        throw std::runtime_error("Mapping a serialized LongNum needs a little-endian host");
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    if ((std::size_t)info.st_size < SERIAL_HEADER_SIZE) {
+        close(fd);
+        throw std::invalid_argument("Truncated serialized LongNum");
+    }
+    std::size_t mapping_size = info.st_size;
+    void* mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    const unsigned char* data = (const unsigned char*)mapping;
+    try {
+        uint64_t n = read_serial_header(data, sign, binary_point);
+        if (n > (mapping_size - SERIAL_HEADER_SIZE) / sizeof(limb_t)) {
+            throw std::invalid_argument("Truncated serialized LongNum");
+        }
+        limbs = std::span<const limb_t>((const limb_t*)(data + SERIAL_HEADER_SIZE), n);
+        check_serial_limbs(sign, limbs.data(), limbs.size());
+        file = new MappedFile(mapping, mapping_size);
+    } catch (...) {
+        munmap(mapping, mapping_size);
+        throw;
+    }
+}
+
+LongNumMapping::~LongNumMapping() {
+    if (file != nullptr) {
+        file->unref();
+    }
+}
+
+LongNumMapping::LongNumMapping(LongNumMapping&& other) noexcept
+    : file(std::exchange(other.file, nullptr)), sign(other.sign), binary_point(other.binary_point),
+      limbs(std::exchange(other.limbs, {})) {}
+
+LongNumMapping& LongNumMapping::operator=(LongNumMapping&& other) noexcept {
+    std::swap(file, other.file);
+    std::swap(sign, other.sign);
+    std::swap(binary_point, other.binary_point);
+    std::swap(limbs, other.limbs);
+    return *this;
+}
+
+bool LongNumMapping::negative() const {
+    return sign < 0;
+}
+
+unsigned int LongNumMapping::precision() const {
+    return binary_point;
+}
+
+std::span<const limb_t> LongNumMapping::magnitude() const {
+    return limbs;
+}
+
+LongNum LongNumMapping::value(const LongNum::allocator_type& alloc) const {
+    LongNum result(alloc);
+    // moved in, so the limbs stay borrowed whatever the resource
+    result.limbs = LimbVector(limbs, file);
+    result.sign = sign;
+    result.binary_point = binary_point;
+    result.fix_invariants();
+    return result;
+}
+
 std::ostream& operator<<(std::ostream& stream, const LongNum& number) {
-    return stream << number.to_string();
+    if (stream.width() != 0) {
+        // the string insertion pads to the width with the fill and alignment of the stream
+        return stream << number.to_string();
+    }
+    number.print(stream);
+    return stream;
 }
 
 LongNum operator""_longnum(long double value) {
@@ -703,7 +2915,7 @@ LongNum operator""_longnum(long double value) {
 };
 
 LongNum operator""_longnum(unsigned long long value) {
-    return LongNum((long double) value);
+    return LongNum(value);
 };
 
 LongNum operator""_longnum(const char* number, std::size_t len) {
@@ -2,23 +2,382 @@
 #define HEADER_LONGNUM
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <memory_resource>
+#include <new>
+#include <charconv>
+#include <concepts>
+#include <functional>
 #include <cstdint>
+#include <span>
 #include <iostream>
 #include <string>
 #include <format>
+#include <type_traits>
 
 const int DEFAULT_PRECISION = 64;
 
+// products and carries of limbs go through 128-bit intermediates
+typedef uint64_t limb_t;
+const int LIMB_BITS = 64;
+
+// limbs of a LongNum: up to INLINE_LIMBS of them are kept inside the object, so numbers of
+// the default precision with a small whole part never touch the allocator; larger ones spill to the heap
+// heap buffers are reference counted and shared by copies until one of them writes (copy-on-write),
+// so copying is O(1); the count is atomic, copies of one value may be used from different threads
+// the non-const accessors make the buffer unique, read through a const reference where possible
+// heap buffers come from a std::pmr::memory_resource: a copy keeps the resource of its source (it shares
+// the buffer), an assignment keeps the resource of its target and copies the limbs if the two differ
+// the limbs may also be borrowed from a Lender such as a LongNumMapping, they are shared like a heap buffer
+// and copied on the first write
+class LimbVector {
+public:
+    static const std::size_t INLINE_LIMBS = 4;
+
+    // owns limbs that LimbVectors borrow instead of copying, each of them holds a reference to it
+    // and the last reference deletes it
+    struct Lender {
+        std::atomic<std::size_t> refs = 1;
+
+        virtual ~Lender() = default;
+        void acquire() {
+            refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        void unref() {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+    };
+
+private:
+    // precedes the limbs in a heap buffer
+    struct Header {
+        std::atomic<std::size_t> refs;
+    };
+
+    // the lender is null for the own buffers, whose limbs follow their Header;
+    // borrowed limbs are read-only, any write copies them into an own buffer first
+    struct Heap {
+        limb_t* limbs;
+        Lender* lender;
+    };
+
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+    std::size_t count = 0;
+    // the limbs are inline exactly while the capacity is INLINE_LIMBS
+    std::size_t cap = INLINE_LIMBS;
+    union {
+        limb_t local[INLINE_LIMBS];
+        Heap heap;
+    };
+
+    bool is_inline() const {
+        return cap == INLINE_LIMBS;
+    }
+
+    bool is_borrowed() const {
+        return !is_inline() && heap.lender != nullptr;
+    }
+
+    Header* header() const {
+        return reinterpret_cast<Header*>(heap.limbs) - 1;
+    }
+
+    static std::size_t buffer_size(std::size_t n) {
+        return sizeof(Header) + n * sizeof(limb_t);
+    }
+
+    Heap allocate(std::size_t n) const {
+        Header* header = new (resource->allocate(buffer_size(n), alignof(Header))) Header{1};
+        return {reinterpret_cast<limb_t*>(header + 1), nullptr};
+    }
+
+    void release() {
+        if (is_borrowed()) {
+            heap.lender->unref();
+        } else if (!is_inline() && header()->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            header()->~Header();
+            resource->deallocate(header(), buffer_size(cap), alignof(Header));
+        }
+        cap = INLINE_LIMBS;
+    }
+
+    void acquire() const {
+        if (is_borrowed()) {
+            heap.lender->acquire();
+        } else {
+            header()->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // moves the limbs into a new unique heap buffer of n >= count limbs
+    void grow(std::size_t n) {
+        Heap limbs = allocate(n);
+        std::copy(cbegin(), cend(), limbs.limbs);
+        release();
+        heap = limbs;
+        cap = n;
+    }
+
+    void make_unique() {
+        if (is_shared()) {
+            grow(cap);
+        }
+    }
+
+public:
+    LimbVector() {}
+    explicit LimbVector(std::pmr::memory_resource* _resource) : resource(_resource) {}
+    explicit LimbVector(std::size_t n, limb_t value = 0) {
+        resize(n, value);
+    }
+    template <typename It>
+    LimbVector(It first, It last) {
+        assign(first, last);
+    }
+    LimbVector(std::initializer_list<limb_t> limbs) : LimbVector(limbs.begin(), limbs.end()) {}
+    // borrows the limbs, which the lender keeps alive, taking a reference to it;
+    // a few limbs that fit inline are copied instead
+    LimbVector(std::span<const limb_t> limbs, Lender* lender) {
+        if (limbs.size() <= INLINE_LIMBS) {
+            assign(limbs.begin(), limbs.end());
+            return;
+        }
+        lender->acquire();
+        heap = {const_cast<limb_t*>(limbs.data()), lender};
+        cap = count = limbs.size();
+    }
+
+    LimbVector(const LimbVector& other) : resource(other.resource) {
+        *this = other;
+    }
+    LimbVector(LimbVector&& other) noexcept : resource(other.resource) {
+        *this = std::move(other);
+    }
+    LimbVector& operator=(const LimbVector& other) {
+        if (this == &other) {
+            return *this;
+        }
+        // borrowed limbs don't come from the resource, so they are shared with any of them
+        if (other.is_inline() || (!other.is_borrowed() && *other.resource != *resource)) {
+            assign(other.cbegin(), other.cend());
+            return *this;
+        }
+        other.acquire();
+        release();
+        heap = other.heap;
+        cap = other.cap;
+        count = other.count;
+        return *this;
+    }
+    // allocates, and so may throw, only if the resources differ
+    LimbVector& operator=(LimbVector&& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (other.is_inline() || (!other.is_borrowed() && *other.resource != *resource)) {
+            assign(other.cbegin(), other.cend());
+        } else {
+            release();
+            heap = other.heap;
+            cap = other.cap;
+            count = other.count;
+            other.cap = INLINE_LIMBS;
+        }
+        other.count = 0;
+        return *this;
+    }
+    ~LimbVector() {
+        release();
+    }
+
+    std::pmr::memory_resource* get_resource() const {
+        return resource;
+    }
+    // whether another LimbVector refers to the same heap buffer or the limbs are borrowed,
+    // so that writing them needs a copy
+    bool is_shared() const {
+        return is_borrowed() || (!is_inline() && header()->refs.load(std::memory_order_acquire) > 1);
+    }
+    std::size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    std::size_t capacity() const {
+        return cap;
+    }
+    const limb_t* data() const {
+        return is_inline() ? local : heap.limbs;
+    }
+    limb_t* data() {
+        make_unique();
+        return is_inline() ? local : heap.limbs;
+    }
+    const limb_t* begin() const {
+        return data();
+    }
+    limb_t* begin() {
+        return data();
+    }
+    const limb_t* end() const {
+        return data() + count;
+    }
+    limb_t* end() {
+        return data() + count;
+    }
+    const limb_t* cbegin() const {
+        return data();
+    }
+    const limb_t* cend() const {
+        return data() + count;
+    }
+    const limb_t& operator[](std::size_t i) const {
+        return data()[i];
+    }
+    limb_t& operator[](std::size_t i) {
+        return data()[i];
+    }
+    const limb_t& back() const {
+        return data()[count - 1];
+    }
+    limb_t& back() {
+        return data()[count - 1];
+    }
+
+    // grows geometrically like push_back, so that growing a few limbs at a time stays linear overall
+    void reserve(std::size_t n) {
+        if (n > cap) {
+            grow(std::max(n, 2 * cap));
+        }
+    }
+    void resize(std::size_t n, limb_t value = 0) {
+        if (n > count) {
+            reserve(n);
+            std::fill(data() + count, data() + n, value);
+        }
+        count = n;
+    }
+    template <typename It>
+    void assign(It first, It last) {
+        std::size_t n = std::distance(first, last);
+        if (is_shared() || n > cap) {
+            release();
+            if (n > INLINE_LIMBS) {
+                heap = allocate(n);
+                cap = n;
+            }
+        }
+        std::copy(first, last, data());
+        count = n;
+    }
+    void clear() {
+        count = 0;
+    }
+    void push_back(limb_t value) {
+        if (count == cap) {
+            grow(2 * cap);
+        }
+        data()[count++] = value;
+    }
+    void emplace_back(limb_t value) {
+        push_back(value);
+    }
+    void pop_back() {
+        count--;
+    }
+    // n copies of value before pos
+    limb_t* insert(const limb_t* pos, std::size_t n, limb_t value) {
+        std::size_t i = pos - cbegin();
+        if (count + n > cap) {
+            grow(std::max(count + n, 2 * cap));
+        }
+        limb_t* limbs = data();
+        std::copy_backward(limbs + i, limbs + count, limbs + count + n);
+        std::fill(limbs + i, limbs + i + n, value);
+        count += n;
+        return limbs + i;
+    }
+    limb_t* erase(const limb_t* first, const limb_t* last) {
+        std::size_t i = first - cbegin(), n = last - first;
+        limb_t* limbs = data();
+        std::copy(limbs + i + n, limbs + count, limbs + i);
+        count -= n;
+        return limbs + i;
+    }
+
+    bool operator==(const LimbVector& other) const {
+        if (count == other.count && cbegin() == other.cbegin()) {
+            return true;
+        }
+        return std::equal(cbegin(), cend(), other.cbegin(), other.cend());
+    }
+};
+
+class LongNumDivisor;
+
+// the nodes of the expression templates derive from this, see LongNum::lazy
+struct LongNumExpressionBase {
+    template <typename T>
+    static auto operand(T&& value);
+};
+
+template <typename E>
+concept LongNumExpression = std::is_base_of_v<LongNumExpressionBase, E>;
+
 class LongNum {
     int sign = 1;
     unsigned int binary_point = DEFAULT_PRECISION;
-    std::vector<uint32_t> limbs;
+    // the magnitude is the limbs shifted up by limb_offset whole limbs, the ones below are implicitly zero;
+    // so shifts by whole limbs and changes of precision by them only move the offset
+    std::size_t limb_offset = 0;
+    LimbVector limbs;
 
-    LongNum(int _sign, unsigned int _binary_point, std::vector<uint32_t> _limbs);
+    LongNum(int _sign, unsigned int _binary_point, LimbVector _limbs);
+    LongNum(bool negative, limb_t magnitude, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    template <std::integral T>
+    static bool native_negative(T value) {
+        if constexpr (std::is_signed_v<T>) {
+            return value < 0;
+        } else {
+            return false;
+        }
+    }
+    template <std::integral T>
+    static limb_t native_magnitude(T value) {
+        return native_negative(value) ? -(limb_t)value : (limb_t)value;
+    }
 
     inline void verify_invariants() const;
     inline void fix_invariants();
 
+    // limb i of the magnitude, counting the implicit ones
+    limb_t limb_at(std::size_t i) const;
+    // stores the implicit zero limbs from position offset up
+    void lower_offset(std::size_t offset);
+    // operands of different precisions are read aligned to the higher one in place, without a shifted copy
+    // sign of |this| - |rhs|
+    int compare_magnitude(const LongNum& rhs) const;
+    // *this += rhs_sign * |rhs| in place for rhs of at most the precision of this
+    void add_signed(const LongNum& rhs, int rhs_sign);
+
+    LongNum& add_native(bool negative, limb_t value);
+    LongNum& multiply_native(bool negative, limb_t value);
+    // result = lhs * rhs written over the limbs of result, which must not be an operand
+    static void multiply(LongNum& result, const LongNum& lhs, const LongNum& rhs);
+    LongNum& multiply_add(const LongNum& lhs, const LongNum& rhs, bool subtract);
+    LongNum& multiply_add_native(const LongNum& lhs, bool negative, limb_t value);
+    LongNum& divide_native(bool negative, limb_t divisor);
+    unsigned int division_shift(const LongNum& rhs) const;
+
+    friend class LongNumDivisor;
+    friend class LongNumMapping;
+
 public:
     LongNum() = default;
     ~LongNum() = default;
@@ -28,16 +387,71 @@ public:
     LongNum& operator=(LongNum&& other) = default;
 
     LongNum(long double value);
+    // exact, with DEFAULT_PRECISION
+    template <std::integral T>
+    LongNum(T value) : LongNum(native_negative(value), native_magnitude(value)) {}
+
+    // the limbs are allocated from a memory resource, the default one unless given here;
+    // copies keep the resource of their source and results of operators take the resource
+    // of their left LongNum operand, assignments keep the resource of their target
+    // allocator_type makes containers such as std::pmr::vector<LongNum> pass theirs to the elements;
+    // internal caches don't use it and stay on the global allocator: the normalized limbs and reciprocal
+    // of a LongNumDivisor, the per-base radix powers of to_string/from_string, the per-thread scratch stack
+    // and the per-thread product buffer of *= and the fused multiply-adds (on new_delete_resource)
+    using allocator_type = std::pmr::polymorphic_allocator<limb_t>;
+    explicit LongNum(const allocator_type& alloc);
+    LongNum(const LongNum& other, const allocator_type& alloc);
+    LongNum(LongNum&& other, const allocator_type& alloc);
+    template <std::integral T>
+    LongNum(T value, const allocator_type& alloc) : LongNum(native_negative(value), native_magnitude(value), alloc.resource()) {}
+    allocator_type get_allocator() const;
 
     std::strong_ordering operator<=>(const LongNum& rhs) const;
     bool operator==(const LongNum& rhs) const;
 
+    // the binary operators write the result over the limbs of a temporary operand, an rvalue lhs is moved
+    // into the by-value parameter and an rvalue rhs is taken by the overloads with LongNum&&
+    // (unless its memory resource differs from the one of lhs, which the result has to take)
     LongNum& operator+=(const LongNum& rhs);
     friend LongNum operator+(LongNum lhs, const LongNum& rhs);
+    friend LongNum operator+(const LongNum& lhs, LongNum&& rhs);
 
-    LongNum operator-() const;
+    LongNum operator-() const&;
+    LongNum operator-() &&;
     LongNum& operator-=(const LongNum& rhs);
     friend LongNum operator-(LongNum lhs, const LongNum& rhs);
+    friend LongNum operator-(const LongNum& lhs, LongNum&& rhs);
+
+    // native integers are added, subtracted and multiplied in place on the limbs,
+    // the precision of the result is at least DEFAULT_PRECISION as with a converted operand
+    template <std::integral T>
+    LongNum& operator+=(T rhs) {
+        return add_native(native_negative(rhs), native_magnitude(rhs));
+    }
+    template <std::integral T>
+    friend LongNum operator+(LongNum lhs, T rhs) {
+        lhs += rhs;
+        return lhs;
+    }
+    template <std::integral T>
+    friend LongNum operator+(T lhs, LongNum rhs) {
+        rhs += lhs;
+        return rhs;
+    }
+    template <std::integral T>
+    LongNum& operator-=(T rhs) {
+        return add_native(!native_negative(rhs), native_magnitude(rhs));
+    }
+    template <std::integral T>
+    friend LongNum operator-(LongNum lhs, T rhs) {
+        lhs -= rhs;
+        return lhs;
+    }
+    template <std::integral T>
+    friend LongNum operator-(T lhs, LongNum rhs) {
+        rhs -= lhs;
+        return -std::move(rhs);
+    }
 
     // this coincides with multiplication/division by a power of two!
     // internally just a shift
@@ -47,10 +461,87 @@ public:
     friend LongNum operator>>(LongNum lhs, int rhs);
     
     friend LongNum operator*(LongNum lhs, const LongNum& rhs);
+    friend LongNum operator*(const LongNum& lhs, LongNum&& rhs);
+    // the product is computed into a buffer kept by the calling thread, which then trades limbs with this,
+    // so repeated products of similar sizes don't allocate
     LongNum& operator*=(const LongNum& rhs);
+    template <std::integral T>
+    LongNum& operator*=(T rhs) {
+        return multiply_native(native_negative(rhs), native_magnitude(rhs));
+    }
+    template <std::integral T>
+    friend LongNum operator*(LongNum lhs, T rhs) {
+        lhs *= rhs;
+        return lhs;
+    }
+    template <std::integral T>
+    friend LongNum operator*(T lhs, LongNum rhs) {
+        rhs *= lhs;
+        return rhs;
+    }
 
     LongNum& operator/=(const LongNum& rhs);
     friend LongNum operator/(LongNum lhs, const LongNum& rhs);
+    LongNum& operator/=(const LongNumDivisor& rhs);
+    friend LongNum operator/(LongNum lhs, const LongNumDivisor& rhs);
+
+    // division by a native integer in a single pass over the limbs,
+    // the precision of the result is at least DEFAULT_PRECISION as with a converted divisor
+    template <std::integral T>
+    LongNum& operator/=(T rhs) {
+        return divide_native(native_negative(rhs), native_magnitude(rhs));
+    }
+    template <std::integral T>
+    friend LongNum operator/(LongNum lhs, T rhs) {
+        lhs /= rhs;
+        return lhs;
+    }
+
+    // fused multiply-add: *this += lhs * rhs and *this -= lhs * rhs without a temporary LongNum,
+    // the product goes through a buffer kept by the calling thread; the results are those of the separate operators
+    LongNum& add_product(const LongNum& lhs, const LongNum& rhs);
+    LongNum& sub_product(const LongNum& lhs, const LongNum& rhs);
+    template <std::integral T>
+    LongNum& add_product(const LongNum& lhs, T rhs) {
+        return multiply_add_native(lhs, native_negative(rhs), native_magnitude(rhs));
+    }
+    template <std::integral T>
+    LongNum& sub_product(const LongNum& lhs, T rhs) {
+        return multiply_add_native(lhs, !native_negative(rhs), native_magnitude(rhs));
+    }
+
+    // opt-in expression templates: operators with an operand from lazy() build an expression
+    // instead of evaluating every step into a temporary; converting or assigning it to a LongNum evaluates it,
+    // += and -= accumulate it term by term into this, with products going through add_product/sub_product;
+    // the results are those of the plain operators. An expression refers to the LongNum values it's made of
+    // (temporaries are moved in), so it's meant to be used in the statement that builds it, not kept with auto
+    auto lazy() const&;
+    auto lazy() &&;
+    template <LongNumExpression E>
+    LongNum(const E& expression) : LongNum(expression.evaluate()) {}
+    template <LongNumExpression E>
+    LongNum& operator+=(const E& expression) {
+        // a term written before another one reads this would change it
+        if (expression.refers_to(*this)) {
+            return *this += LongNum(expression);
+        }
+        expression.add_to(*this, false);
+        return *this;
+    }
+    template <LongNumExpression E>
+    LongNum& operator-=(const E& expression) {
+        if (expression.refers_to(*this)) {
+            return *this -= LongNum(expression);
+        }
+        expression.add_to(*this, true);
+        return *this;
+    }
+
+    // divides in place keeping the precision, truncating toward zero
+    LongNum& divide_by(limb_t divisor);
+    // divides the whole part in place dropping the fraction, returns the remainder
+    // of the magnitude (the quotient keeps the sign, as with integer division)
+    limb_t divmod_small(limb_t divisor);
 
     // bits left of the binary point are adressed by negative indicies
     bool get_bit(int pos) const;
@@ -71,18 +562,380 @@ public:
     std::string to_binary_string() const;
     static LongNum from_binary_string(const std::string& number);
 
-    std::string to_string(unsigned int base = 10) const;
+    // how to_string rounds a fraction cut at fewer digits than it has
+    enum class Rounding { TOWARD_ZERO, AWAY_FROM_ZERO, HALF_AWAY_FROM_ZERO, HALF_EVEN };
+    static constexpr std::size_t ALL_DIGITS = SIZE_MAX;
+
+    // at most max_fraction_digits digits of the fraction are generated, the last one rounded;
+    // all of them are exact for even bases, for odd ones the expansion is cut where the precision ends
+    std::string to_string(unsigned int base = 10, std::size_t max_fraction_digits = ALL_DIGITS, Rounding rounding = Rounding::HALF_EVEN) const;
     static LongNum from_string(const std::string& number, unsigned int base = 10);
 
+    // like std::to_chars: writes the text of to_string into [first, last) without allocating a string,
+    // or returns errc::value_too_large if it doesn't fit; to_chars_size is an upper bound of its length
+    std::to_chars_result to_chars(char* first, char* last, unsigned int base = 10, std::size_t max_fraction_digits = ALL_DIGITS, Rounding rounding = Rounding::HALF_EVEN) const;
+    std::size_t to_chars_size(unsigned int base = 10, std::size_t max_fraction_digits = ALL_DIGITS) const;
+    // like std::from_chars: parses an optional minus and digits with an optional point from the start
+    // of [first, last), the result has the precision from_string gives, value is untouched on errors
+    static std::from_chars_result from_chars(const char* first, const char* last, LongNum& value, unsigned int base = 10);
+    // the text of to_string handed out in pieces of bounded size as it's generated, so huge numbers
+    // are printed without building the whole string; operator<< goes through this unless the stream
+    // has a width set, which pads the whole text
+    void print(const std::function<void(std::string_view)>& sink, unsigned int base = 10, std::size_t max_fraction_digits = ALL_DIGITS, Rounding rounding = Rounding::HALF_EVEN) const;
+    void print(std::ostream& stream, unsigned int base = 10, std::size_t max_fraction_digits = ALL_DIGITS, Rounding rounding = Rounding::HALF_EVEN) const;
+
+    // a versioned binary format: the bytes "LNUM", 16-bit version, 16-bit flags (bit 0 is the sign),
+    // 32-bit binary_point, 32 reserved bits, 64-bit limb count and the limbs, all little-endian;
+    // the limbs start 8-byte aligned so the format can be mapped into memory as is (see LongNumMapping)
+    void serialize(std::ostream& stream) const;
+    static LongNum deserialize(std::istream& stream, const allocator_type& alloc = {});
+
     unsigned int precision() const;
     void set_precision(unsigned int precision);
     LongNum with_precision(unsigned int precision) const;
+
+    // the kernels take their temporary limbs from a scratch stack kept by each thread between
+    // operations, so arithmetic repeated at similar sizes doesn't allocate for them;
+    // the peak use of the calling thread's stack in bytes, and a release of its memory down to the current use
+    static std::size_t scratch_high_water();
+    static void trim_scratch();
+};
+
+// a LongNum in an expression, referred to, or held if it was a temporary
+template <typename T>
+class LongNumOperand : public LongNumExpressionBase {
+    T value;
+
+public:
+    explicit LongNumOperand(T _value) : value(std::forward<T>(_value)) {}
+
+    const LongNum& evaluate() const {
+        return value;
+    }
+    const LongNum& factor() const {
+        return value;
+    }
+    bool refers_to(const LongNum& number) const {
+        return &number == &value;
+    }
+    void add_to(LongNum& into, bool subtract) const {
+        subtract ? into -= value : into += value;
+    }
+};
+
+// a native integer in an expression, kept as is for the native overloads
+template <std::integral T>
+class LongNumScalar : public LongNumExpressionBase {
+    T value;
+
+public:
+    explicit LongNumScalar(T _value) : value(_value) {}
+
+    LongNum evaluate() const {
+        return value;
+    }
+    T factor() const {
+        return value;
+    }
+    bool refers_to(const LongNum&) const {
+        return false;
+    }
+    void add_to(LongNum& into, bool subtract) const {
+        subtract ? into -= value : into += value;
+    }
+};
+
+template <typename E>
+class LongNumNegation : public LongNumExpressionBase {
+    E operand;
+
+public:
+    explicit LongNumNegation(E _operand) : operand(std::move(_operand)) {}
+
+    LongNum evaluate() const {
+        return -operand.evaluate();
+    }
+    LongNum factor() const {
+        return evaluate();
+    }
+    bool refers_to(const LongNum& number) const {
+        return operand.refers_to(number);
+    }
+    void add_to(LongNum& into, bool subtract) const {
+        operand.add_to(into, !subtract);
+    }
+};
+
+// lhs + rhs, or lhs - rhs if SUBTRACT: the terms are added to the destination one after another
+template <typename L, typename R, bool SUBTRACT>
+class LongNumSum : public LongNumExpressionBase {
+    L lhs;
+    R rhs;
+
+public:
+    LongNumSum(L _lhs, R _rhs) : lhs(std::move(_lhs)), rhs(std::move(_rhs)) {}
+
+    LongNum evaluate() const {
+        LongNum result = lhs.evaluate();
+        rhs.add_to(result, SUBTRACT);
+        return result;
+    }
+    LongNum factor() const {
+        return evaluate();
+    }
+    bool refers_to(const LongNum& number) const {
+        return lhs.refers_to(number) || rhs.refers_to(number);
+    }
+    void add_to(LongNum& into, bool subtract) const {
+        lhs.add_to(into, subtract);
+        rhs.add_to(into, subtract != SUBTRACT);
+    }
+};
+
+// lhs * rhs: added to the destination by a fused multiply-add, the factors that are expressions are evaluated first
+template <typename L, typename R>
+class LongNumProduct : public LongNumExpressionBase {
+    L lhs;
+    R rhs;
+
+public:
+    LongNumProduct(L _lhs, R _rhs) : lhs(std::move(_lhs)), rhs(std::move(_rhs)) {}
+
+    LongNum evaluate() const {
+        return lhs.factor() * rhs.factor();
+    }
+    LongNum factor() const {
+        return evaluate();
+    }
+    bool refers_to(const LongNum& number) const {
+        return lhs.refers_to(number) || rhs.refers_to(number);
+    }
+    void add_to(LongNum& into, bool subtract) const {
+        // a native factor goes second, to the scalar overloads
+        if constexpr (std::is_integral_v<decltype(lhs.factor())>) {
+            subtract ? into.sub_product(rhs.factor(), lhs.factor()) : into.add_product(rhs.factor(), lhs.factor());
+        } else {
+            subtract ? into.sub_product(lhs.factor(), rhs.factor()) : into.add_product(lhs.factor(), rhs.factor());
+        }
+    }
+};
+
+// expressions are taken as they are, native integers as scalars and anything else as a LongNum
+template <typename T>
+auto LongNumExpressionBase::operand(T&& value) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (LongNumExpression<U>) {
+        return U(std::forward<T>(value));
+    } else if constexpr (std::is_integral_v<U>) {
+        return LongNumScalar<U>(value);
+    } else if constexpr (std::is_same_v<U, LongNum> && std::is_lvalue_reference_v<T>) {
+        return LongNumOperand<const LongNum&>(value);
+    } else {
+        return LongNumOperand<LongNum>(LongNum(std::forward<T>(value)));
+    }
+}
+
+inline auto LongNum::lazy() const& {
+    return LongNumOperand<const LongNum&>(*this);
+}
+
+inline auto LongNum::lazy() && {
+    return LongNumOperand<LongNum>(std::move(*this));
+}
+
+// one of the operands is an expression, the other one is or converts to a LongNum
+template <typename L, typename R>
+concept LongNumExpressionOperands =
+    (LongNumExpression<std::remove_cvref_t<L>> || LongNumExpression<std::remove_cvref_t<R>>) &&
+    (LongNumExpression<std::remove_cvref_t<L>> || std::convertible_to<L, LongNum>) &&
+    (LongNumExpression<std::remove_cvref_t<R>> || std::convertible_to<R, LongNum>);
+
+template <typename L, typename R>
+    requires LongNumExpressionOperands<L, R>
+auto operator+(L&& lhs, R&& rhs) {
+    auto l = LongNumExpressionBase::operand(std::forward<L>(lhs));
+    auto r = LongNumExpressionBase::operand(std::forward<R>(rhs));
+    return LongNumSum<decltype(l), decltype(r), false>(std::move(l), std::move(r));
+}
+
+template <typename L, typename R>
+    requires LongNumExpressionOperands<L, R>
+auto operator-(L&& lhs, R&& rhs) {
+    auto l = LongNumExpressionBase::operand(std::forward<L>(lhs));
+    auto r = LongNumExpressionBase::operand(std::forward<R>(rhs));
+    return LongNumSum<decltype(l), decltype(r), true>(std::move(l), std::move(r));
+}
+
+template <typename L, typename R>
+    requires LongNumExpressionOperands<L, R>
+auto operator*(L&& lhs, R&& rhs) {
+    auto l = LongNumExpressionBase::operand(std::forward<L>(lhs));
+    auto r = LongNumExpressionBase::operand(std::forward<R>(rhs));
+    return LongNumProduct<decltype(l), decltype(r)>(std::move(l), std::move(r));
+}
+
+template <LongNumExpression E>
+auto operator-(const E& operand) {
+    return LongNumNegation<E>(operand);
+}
+
+// a divisor prepared for many divisions by the same value: the limbs are normalized
+// and a reciprocal of their top part is computed once (Barrett style), so a large division
+// costs a couple of multiplications; results are the same as dividing by value()
+class LongNumDivisor {
+    LongNum divisor;
+    int shift = 0;
+    std::vector<limb_t> normalized;
+    std::vector<limb_t> reciprocal;
+
+    friend class LongNum;
+
+public:
+    explicit LongNumDivisor(LongNum _divisor);
+
+    const LongNum& value() const;
+};
+
+// a file written by LongNum::serialize mapped read-only into memory: the limbs are used in place,
+// so loading costs no more than validating the header; the values borrow the mapped limbs without copying
+// them and keep the file mapped until the last of them and the mapping are gone
+// works on little-endian hosts with POSIX mmap
+class LongNumMapping {
+    // unmaps the file with the last reference
+    LimbVector::Lender* file = nullptr;
+    int sign = 1;
+    unsigned int binary_point = 0;
+    std::span<const limb_t> limbs;
+
+public:
+    explicit LongNumMapping(const std::string& path);
+    ~LongNumMapping();
+    LongNumMapping(const LongNumMapping&) = delete;
+    LongNumMapping& operator=(const LongNumMapping&) = delete;
+    LongNumMapping(LongNumMapping&& other) noexcept;
+    LongNumMapping& operator=(LongNumMapping&& other) noexcept;
+
+    bool negative() const;
+    unsigned int precision() const;
+    // little-endian limbs of the magnitude, the top one is non-zero
+    std::span<const limb_t> magnitude() const;
+    LongNum value(const LongNum::allocator_type& alloc = {}) const;
 };
 
+// the spec is [[fill]align][width][.precision][type], parsed in that order:
+// the precision in {:.50} cuts the fraction at that many digits rounding half to even,
+// the type picks the base: b, o, d (the default), x or X for uppercase digits;
+// fill, alignment and width work as for strings, the width may be a {} or {n} replacement field
 template <>
-struct std::formatter<LongNum> : std::formatter<std::string> {
+struct std::formatter<LongNum> {
+    unsigned int base = 10;
+    bool uppercase = false;
+    std::size_t fraction_digits = LongNum::ALL_DIGITS;
+    char fill = ' ';
+    char align = '<';
+    std::size_t width = 0;
+    // the argument holding the width when it's given by a replacement field
+    std::size_t width_arg = SIZE_MAX;
+
+    static constexpr bool is_align(char c) {
+        return c == '<' || c == '>' || c == '^';
+    }
+
+    static constexpr bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    constexpr auto parse(std::format_parse_context& ctx) {
+        auto it = ctx.begin();
+        auto end = ctx.end();
+        if (end - it >= 2 && *it != '{' && *it != '}' && is_align(it[1])) {
+            fill = it[0];
+            align = it[1];
+            it += 2;
+        } else if (it != end && is_align(*it)) {
+            align = *it;
+            it++;
+        }
+        if (it != end && *it == '{') {
+            it++;
+            if (it != end && *it == '}') {
+                width_arg = ctx.next_arg_id();
+            } else {
+                std::size_t id = 0;
+                if (it == end || !is_digit(*it)) {
+                    throw std::format_error("Invalid width argument in a LongNum format spec");
+                }
+                while (it != end && is_digit(*it)) {
+                    id = id * 10 + (*it++ - '0');
+                }
+                ctx.check_arg_id(id);
+                width_arg = id;
+            }
+            if (it == end || *it != '}') {
+                throw std::format_error("Invalid width argument in a LongNum format spec");
+            }
+            it++;
+        } else {
+            while (it != end && is_digit(*it)) {
+                width = width * 10 + (*it++ - '0');
+            }
+        }
+        if (it != end && *it == '.') {
+            it++;
+            if (it == end || !is_digit(*it)) {
+                throw std::format_error("Missing precision after '.' in a LongNum format spec");
+            }
+            fraction_digits = 0;
+            while (it != end && is_digit(*it)) {
+                fraction_digits = fraction_digits * 10 + (*it++ - '0');
+            }
+        }
+        if (it != end && *it != '}') {
+            switch (*it) {
+                case 'b': base = 2; break;
+                case 'o': base = 8; break;
+                case 'd': base = 10; break;
+                case 'x': base = 16; break;
+                case 'X': base = 16; uppercase = true; break;
+                default: throw std::format_error("Invalid type in a LongNum format spec");
+            }
+            it++;
+        }
+        if (it != end && *it != '}') {
+            throw std::format_error("Invalid LongNum format spec");
+        }
+        return it;
+    }
+
     auto format(const LongNum& number, std::format_context& ctx) const {
-        return std::formatter<std::string>::format(number.to_string(), ctx);
+        std::string result = number.to_string(base, fraction_digits);
+        if (uppercase) {
+            for (char& c : result) {
+                if (c >= 'a' && c <= 'f') {
+                    c += 'A' - 'a';
+                }
+            }
+        }
+        std::size_t total_width = width;
+        if (width_arg != SIZE_MAX) {
+            total_width = std::visit_format_arg([](auto value) -> std::size_t {
+                if constexpr (std::is_integral_v<decltype(value)> && !std::is_same_v<decltype(value), bool> && !std::is_same_v<decltype(value), char>) {
+                    if constexpr (std::is_signed_v<decltype(value)>) {
+                        if (value < 0) {
+                            throw std::format_error("Negative width in a LongNum format spec");
+                        }
+                    }
+                    return value;
+                } else {
+                    throw std::format_error("Width of a LongNum format spec is not an integer");
+                }
+            }, ctx.arg(width_arg));
+        }
+        std::size_t padding = total_width > result.size() ? total_width - result.size() : 0;
+        std::size_t before = align == '>' ? padding : align == '^' ? padding / 2 : 0;
+        auto out = std::fill_n(ctx.out(), before, fill);
+        out = std::copy(result.begin(), result.end(), out);
+        return std::fill_n(out, padding - before, fill);
     }
 };
 
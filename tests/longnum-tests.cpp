@@ -1,5 +1,9 @@
 #include"../src/longnum.hpp"
 #include"../tests/utils.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
 
 
 void test_longnum_conversion() {
@@ -36,6 +40,114 @@ void test_longnum_conversion() {
     assert_eq(LongNum(0).with_precision(0).to_binary_string(), std::string("0"));
     assert_eq(LongNum(0).with_precision(0).to_string(), std::string("0"));
     assert_eq(LongNum(-123).with_precision(0).to_string(), std::string("-123"));
+
+    assert_eq(LongNum(-5), LongNum(-5.0l));
+    assert_eq(LongNum(7).precision(), (unsigned int)DEFAULT_PRECISION);
+    assert_eq(LongNum(std::numeric_limits<int64_t>::min()).to_string(), std::string("-9223372036854775808"));
+    assert_eq(LongNum(std::numeric_limits<uint64_t>::max()).to_string(), std::string("18446744073709551615"));
+    assert_eq(LongNum((unsigned char)200), LongNum(200));
+    assert_eq(18446744073709551615_longnum, (LongNum(1) << 64) - 1);
+
+    // long conversions are split at powers of the base
+    assert_eq(LongNum(10).pow(500).to_string(), "1" + std::string(500, '0'));
+    assert_eq((LongNum(10).pow(500) - 1).with_precision(0).to_string(), std::string(500, '9'));
+    assert_eq((-(LongNum(1) << 4000)).to_string(16), "-1" + std::string(1000, '0'));
+    assert_eq((LongNum(1).with_precision(100) >> 100).to_string(), std::string("0.0000000000000000000000000000007888609052210118054117285652827862296732064351090230047702789306640625"));
+    LongNum big = LongNum(7).pow(3000) + (LongNum(1).with_precision(3000) >> 3000);
+    std::string big_string = big.to_string();
+    assert_eq(big_string.size(), 2536u + 1 + 3000);
+    assert_eq(LongNum::from_string(big_string), big);
+    assert_eq(LongNum::from_string(big.to_string(12), 12), big);
+
+    // long strings are parsed in halves combined with powers of the base
+    assert_eq(LongNum::from_string("1" + std::string(5000, '0')), LongNum(10).pow(5000).with_precision(0));
+    assert_eq(LongNum::from_string("-" + std::string(3000, 'F'), 16), -(LongNum(1) << 12000) + 1);
+    assert_eq(LongNum::from_string(std::string(2000, '9') + "." + std::string(2000, '0')), (LongNum(10).pow(2000) - 1).with_precision(6644));
+    assert_eq(LongNum::from_string(std::string(2000, '9') + "." + std::string(2000, '0')).precision(), 6644u);
+    // base^fraction stays prepared for the next number with as many fraction digits
+    LongNum fine = LongNum(7).pow(100) + (LongNum(1).with_precision(7000) >> 7000);
+    for (const LongNum& value : {fine, fine + (LongNum(1).with_precision(7000) >> 6999), -fine}) {
+        assert_eq(LongNum::from_string(value.to_string()), value);
+    }
+    assert_eq(LongNum::from_string("0.5"), LongNum(0.5));
+    assert_eq(LongNum::from_string(fine.to_string()), fine);
+
+    // the fraction can be cut at a number of digits with rounding
+    LongNum x = LongNum::from_string("-255.99951171875");
+    assert_eq(x.to_string(10, 20), std::string("-255.99951171875"));
+    assert_eq(x.to_string(10, 3), std::string("-256.000"));
+    assert_eq(x.to_string(10, 3, LongNum::Rounding::TOWARD_ZERO), std::string("-255.999"));
+    assert_eq(x.to_string(10, 0, LongNum::Rounding::TOWARD_ZERO), std::string("-255"));
+    assert_eq(x.to_string(16, 2, LongNum::Rounding::AWAY_FROM_ZERO), std::string("-100.00"));
+    assert_eq(x.to_string(2, 3, LongNum::Rounding::TOWARD_ZERO), std::string("-11111111.111"));
+    LongNum quarter = LongNum(1) >> 2, three_quarters = LongNum(3) >> 2;
+    assert_eq(quarter.to_string(10, 1), std::string("0.2"));
+    assert_eq(three_quarters.to_string(10, 1), std::string("0.8"));
+    assert_eq(quarter.to_string(10, 1, LongNum::Rounding::HALF_AWAY_FROM_ZERO), std::string("0.3"));
+    assert_eq((-quarter).to_string(10, 1, LongNum::Rounding::HALF_AWAY_FROM_ZERO), std::string("-0.3"));
+    assert_eq((LongNum(1).with_precision(3000) / 3).to_string(10, 5), std::string("0.33333"));
+    assert_eq((LongNum(2).with_precision(3000) / 3).to_string(10, 5), std::string("0.66667"));
+    assert_eq((LongNum(2).with_precision(3000) / 3).to_string(3, 4), std::string("0.2000"));
+    // ties with no fraction digits round to an even whole part
+    for (auto [value, rounded] : {std::pair{0.5, "0"}, {1.5, "2"}, {2.5, "2"}, {3.5, "4"}}) {
+        assert_eq(LongNum(value).to_string(10, 0), std::string(rounded));
+        assert_eq(LongNum(-value).to_string(10, 0), "-" + std::string(rounded));
+        assert_eq(std::format("{:.0}", LongNum(value)), std::string(rounded));
+    }
+    assert_eq(LongNum(2.5).to_string(16, 0), std::string("2"));
+    assert_eq(LongNum(2.5).to_string(10, 0, LongNum::Rounding::HALF_AWAY_FROM_ZERO), std::string("3"));
+    assert_eq(std::format("{:.2}|{:x}|{:.1X}|{:>8.0}|{:*<9.1d}", x, x, x, x, x), std::string("-256.00|-ff.ffe|-100.0|    -256|-256.0***"));
+    assert_eq(std::format("{:.>10.1}|{:.^9}|{:.<2}", x, LongNum(5), LongNum(5)), std::string("....-256.0|....5....|5."));
+    assert_eq(std::format("{:>{}.1}|{:{}x}", x, 9, x, 10), std::string("   -256.0|-ff.ffe   "));
+    assert_eq(std::format("{0:*<{1}}|{0:{2}}", LongNum(1), 4, 3u), std::string("1***|1  "));
+
+    // conversions into and from caller buffers
+    char buffer[64];
+    std::to_chars_result written = x.to_chars(buffer, buffer + sizeof(buffer));
+    assert(written.ec == std::errc());
+    assert_eq(std::string(buffer, written.ptr), x.to_string());
+    assert(x.to_chars(buffer, buffer + 5).ec == std::errc::value_too_large);
+    assert(x.to_chars_size() >= x.to_string().size());
+    assert(big.to_chars_size(7) >= big.to_string(7).size());
+    assert(x.to_chars_size(2) >= x.to_string(2).size());
+    written = x.to_chars(buffer, buffer + sizeof(buffer), 16, 1);
+    assert_eq(std::string(buffer, written.ptr), std::string("-100.0"));
+    assert_eq(LongNum(1000).with_precision(0).to_binary_string(), std::string("1111101000"));
+    std::string text = "-12.5e3";
+    LongNum parsed = 7;
+    std::from_chars_result read = LongNum::from_chars(text.data(), text.data() + text.size(), parsed);
+    assert(read.ec == std::errc() && read.ptr == text.data() + 5);
+    assert_eq(parsed, LongNum(-25) >> 1);
+    assert_eq(parsed.precision(), 4u);
+    text = "Ff.8";
+    read = LongNum::from_chars(text.data(), text.data() + text.size(), parsed, 16);
+    assert(read.ec == std::errc() && read.ptr == text.data() + text.size());
+    assert_eq(parsed, LongNum(511) >> 1);
+    text = "+1";
+    read = LongNum::from_chars(text.data(), text.data() + text.size(), parsed);
+    assert(read.ec == std::errc::invalid_argument && read.ptr == text.data());
+    assert_eq(parsed, LongNum(511) >> 1);
+
+    // printing hands out the text in bounded pieces
+    std::stringstream stream;
+    stream << x << ' ' << big;
+    assert_eq(stream.str(), x.to_string() + " " + big_string);
+    // a width set on the stream pads the number, not the next insertion
+    stream.str("");
+    stream << '[' << std::setw(10) << std::setfill('*') << LongNum(42) << "]" << LongNum(7) << '[' << std::left << std::setw(4) << LongNum(-1) << ']';
+    assert_eq(stream.str(), std::string("[********42]7[-1**]"));
+    LongNum huge = LongNum(3).pow(150000);
+    std::string printed;
+    std::size_t largest_piece = 0;
+    huge.print([&](std::string_view piece) {
+        printed += piece;
+        largest_piece = std::max(largest_piece, piece.size());
+    });
+    assert_eq(printed, huge.to_string());
+    assert_eq(printed.size(), 71569u);
+    assert(largest_piece <= 1u << 16);
+    // odd bases don't terminate and are cut at the precision
+    assert_eq(LongNum(0.5).with_precision(64).to_string(3), "0." + std::string(41, '1'));
 }
 
 void test_longnum_comparison() {
@@ -199,6 +311,32 @@ void test_longnum_comparison() {
     assert(y >= x);
     assert(!(y < x));
     assert(!(y <= x));
+
+    // operands of different precisions
+    x = LongNum(3).with_precision(130) >> 100;
+    y = (LongNum(3) << 64).with_precision(0) >> 64;
+    assert(x < y);
+    assert(y > x);
+    assert(-x > -y);
+    assert(x != y);
+    assert((x << 100) == y);
+    assert(y == (x << 100));
+    assert(LongNum(0).with_precision(0) == LongNum(0).with_precision(200));
+    assert(LongNum(1).with_precision(0) < (LongNum(1).with_precision(200) + (LongNum(1).with_precision(200) >> 200)));
+    assert(((LongNum(1) << 200) - 1).with_precision(0) < (LongNum(1) << 200).with_precision(77));
+    // <=> agrees with == whatever the precisions and limb offsets of equal values
+    std::vector<LongNum> values;
+    for (unsigned int precision : {0u, 64u, 77u, 200u}) {
+        for (const LongNum& value : {LongNum(0), LongNum(1), LongNum(-1), LongNum(5) << 300, -(LongNum(3) << 130), LongNum(1) >> 64}) {
+            values.push_back(value.with_precision(precision));
+        }
+    }
+    for (const LongNum& a : values) {
+        for (const LongNum& b : values) {
+            assert_eq((a <=> b) == 0, a == b);
+            assert_eq((a <=> b) < 0, (b <=> a) > 0);
+        }
+    }
 }
 
 void test_longnum_addition_subtraction() {
@@ -271,6 +409,78 @@ void test_longnum_addition_subtraction() {
     assert_eq(y, "11100110100101010110111110001100111011111.0000000010011100011111110000011001011110100111010100001001"_longnum);
 
     assert_eq((LongNum(1) << 31) + (LongNum(1) << 31), LongNum(1) << 32);
+    assert_eq((LongNum(1) << 63) + (LongNum(1) << 63), LongNum(1) << 64);
+    assert_eq((LongNum(1) << 64) - 1, "1111111111111111111111111111111111111111111111111111111111111111"_longnum);
+    assert_eq(((LongNum(1) << 64) - 1) * ((LongNum(1) << 64) - 1), (LongNum(1) << 128) - (LongNum(1) << 65) + 1);
+
+    // native integer operands
+    x = 0.5;
+    assert_eq(x - 1, LongNum(-0.5));
+    assert_eq(x + -1, LongNum(-0.5));
+    assert_eq(1 - x, LongNum(0.5));
+    assert_eq(LongNum(-2.25) + 5, LongNum(2.75));
+    assert_eq(LongNum(-2.25) - 5u, LongNum(-7.25));
+    assert_eq(LongNum(2) - 2, LongNum(0));
+    assert_eq((LongNum(2) - 2).to_string(), std::string("0"));
+    assert_eq(LongNum(std::numeric_limits<uint64_t>::max()) + 1, LongNum(1) << 64);
+    assert_eq((LongNum(1) << 64) - 1u, LongNum(std::numeric_limits<uint64_t>::max()));
+    assert_eq(LongNum(std::numeric_limits<int64_t>::min()) - std::numeric_limits<int64_t>::min(), LongNum(0));
+    x = LongNum(1).with_precision(100);
+    x += 3;
+    assert_eq(x, LongNum(4));
+    x -= 10;
+    assert_eq(x, LongNum(-6));
+    assert_eq(x.precision(), 100u);
+    assert_eq(LongNum(1).with_precision(0) + 1, LongNum(2));
+    assert_eq((LongNum(1).with_precision(0) + 1).precision(), (unsigned int)DEFAULT_PRECISION);
+    x = (LongNum(1) << 300) + 0.25;
+    x -= 7;
+    assert_eq(x, (LongNum(1) << 300) - 6.75);
+
+    // operands of different precisions
+    x = (LongNum(1).with_precision(100) >> 100) + LongNum(0.75);
+    assert_eq(x.precision(), 100u);
+    assert_eq(x - (LongNum(1).with_precision(100) >> 100), LongNum(0.75));
+    y = (LongNum(-1) << 200) + 0.5;
+    y.set_precision(1);
+    assert_eq(x + y, (LongNum(-1) << 200) + 1.25 + (LongNum(1).with_precision(100) >> 100));
+    assert_eq(y - x, (LongNum(-1) << 200) - 0.25 - (LongNum(1).with_precision(100) >> 100));
+    assert_eq((y - x).precision(), 100u);
+    y = ((LongNum(1) << 130) - 1).with_precision(0);
+    x = LongNum(1).with_precision(130) >> 130;
+    assert_eq((y + x) << 130, (y << 130) + 1);
+    assert_eq(y + x - x, y);
+    assert_eq(x - y + y, x);
+    assert_eq((y - LongNum(0).with_precision(150)).precision(), 150u);
+    assert_eq((y + LongNum(0).with_precision(150)).precision(), 150u);
+
+    // mixed signs, either magnitude larger, in place
+    x = (LongNum(1) << 200) + 0.5;
+    y = -((LongNum(1) << 200) - 0.25);
+    assert_eq(x + y, LongNum(0.75));
+    assert_eq(y + x, LongNum(0.75));
+    assert_eq(y - -x, LongNum(0.75));
+    assert_eq(-x - y, LongNum(-0.75));
+    LongNum z = LongNum(0.5).with_precision(300);
+    z -= LongNum(1) << 250;
+    assert_eq(z, 0.5 - (LongNum(1) << 250));
+    z += LongNum(1) << 251;
+    assert_eq(z, (LongNum(1) << 250) + 0.5);
+    assert_eq(z.precision(), 300u);
+    z -= z;
+    assert_eq(z, LongNum(0));
+    assert_eq(z.precision(), 300u);
+    z = x;
+    z += -x;
+    assert_eq(z.to_string(), std::string("0"));
+    z = LongNum(0);
+    LongNum positive = 0, negative = 0;
+    for (int i = 1; i <= 100; i++) {
+        z += (i % 2 ? -1 : 1) * (LongNum(i) << (3 * i));
+        (i % 2 ? negative : positive) += LongNum(i) << (3 * i);
+    }
+    assert_eq(z, positive - negative);
+    assert_eq(-z, negative - positive);
 }
 
 void test_longnum_shifts() {
@@ -328,6 +538,29 @@ void test_longnum_shifts() {
     assert_eq(x, x >> 0);
     assert_eq(x, x << 0);
     assert_eq(x, LongNum(673586480112));
+
+    // whole limbs of a shift are kept as implicit zero limbs, the values mix with ones without them
+    LongNum wide = (LongNum(3) << 640) + 5;
+    LongNum shifted = LongNum(3) << 640;
+    assert_eq(wide - shifted, LongNum(5));
+    assert_eq(shifted - wide, LongNum(-5));
+    assert(shifted < wide && wide > shifted);
+    assert_eq(shifted.to_string(16), "3" + std::string(160, '0'));
+    assert_eq(shifted.bit_length(), 642);
+    assert(shifted.get_bit(641) && !shifted.get_bit(64));
+    assert_eq(wide / shifted, LongNum(1));
+    assert_eq(LongNum(7) / shifted, LongNum(0));
+    assert_eq((shifted * 5 + 1) / 3, LongNum::from_string("5" + std::string(160, '0') + ".5555555555555555", 16));
+    assert_eq((shifted >> 641) * (LongNum(1) << 6400), LongNum(3) << 6399);
+    std::stringstream stream;
+    shifted.serialize(stream);
+    assert_eq(LongNum::deserialize(stream), shifted);
+    LongNum bits = shifted;
+    bits.set_bit(3);
+    bits.unset_bit(641);
+    assert_eq(bits, (LongNum(1) << 640) + 8);
+    assert_eq(shifted.with_precision(6400).with_precision(64), shifted);
+    assert_eq(shifted.with_precision(6400) + wide, wide + shifted);
 }
 
 void test_longnum_multiplication() {
@@ -361,6 +594,136 @@ void test_longnum_multiplication() {
 
     y = "111011111100010101011100001000101101000.100111000101010111100000111"_longnum;
     assert_eq(x * y, "10101010101110110100110110001010011111001111011101110101010100010101010.00101111110110010011111001110011110110110101100011000011"_longnum);
+
+    // sizes crossing the Karatsuba and Toom-3 thresholds
+    for (int bits : {1000, 3000, 10000, 30000, 300000}) {
+        x = (LongNum(1) << bits) - 1;
+        assert_eq(x * x, (LongNum(1) << (2 * bits)) - (LongNum(1) << (bits + 1)) + 1);
+        y = LongNum(3).pow(bits / 2);
+        assert_eq((y + 1) * (y - 1), y * y - 1);
+        assert_eq(x * (y + 1), x * y + x);
+        assert_eq(-y * x, -(x * y));
+        // squaring kernels against the general ones
+        LongNum z = y;
+        z *= z;
+        assert_eq(z, y * (y + 1) - y);
+        assert_eq(-y * y, -z);
+    }
+    // products with transform lengths of both shapes, 2^k and 3 * 2^k
+    for (int limbs : {6000, 8000, 8200}) {
+        x = (LongNum(1) << (64 * limbs)) - 1;
+        y = LongNum(3).pow(limbs * 40);
+        assert_eq(x * y, (y << (64 * limbs)) - y);
+        assert_eq(x * x, (LongNum(1) << (128 * limbs)) - (LongNum(1) << (64 * limbs + 1)) + 1);
+    }
+    // unbalanced operands
+    x = LongNum(3).pow(20000);
+    y = LongNum(7).pow(1500);
+    assert_eq(x * y, y * x);
+    assert_eq(x * y * y, x * (y * y));
+    assert_eq(LongNum(3).pow(12000) * LongNum(3).pow(8000), x);
+    assert_eq(LongNum(21).pow(1500) * LongNum(3).pow(18500), x * y);
+
+    // truncated products of high-precision operands against exact integer products
+    for (int precision : {200, 1000, 4000, 20000, 60000}) {
+        x = LongNum(3).pow(precision / 2).with_precision(precision) >> (precision * 3 / 4);
+        y = -LongNum(5).pow(precision / 3).with_precision(precision) >> (precision * 3 / 4);
+        LongNum whole_x = (x << precision).with_precision(0);
+        LongNum whole_y = (y << precision).with_precision(0);
+        LongNum exact = ((whole_x * whole_y).with_precision(2 * precision) >> (2 * precision)).with_precision(precision);
+        assert_eq(x * y, exact);
+        assert_eq((x * x).with_precision(2 * precision), ((whole_x * whole_x).with_precision(2 * precision) >> (2 * precision)).with_precision(precision));
+        // the discarded part carries all the way into the last kept bit
+        LongNum epsilon = LongNum(1).with_precision(precision) >> precision;
+        x = LongNum(1).with_precision(precision) - epsilon;
+        assert_eq(x * (x + 2 * epsilon), x);
+        assert_eq((x + 2 * epsilon) * x, x);
+        assert_eq(x * x, x - epsilon);
+        // a long integer part makes the operands unbalanced above the cut
+        x = LongNum(7).pow(precision / 2) + LongNum(3).pow(precision / 2).with_precision(precision) / LongNum(7).pow(precision / 3);
+        whole_x = (x << precision).with_precision(0);
+        assert_eq(x * y, ((whole_x * whole_y).with_precision(2 * precision) >> (2 * precision)).with_precision(precision));
+        assert_eq(y * x, x * y);
+    }
+
+    // native integer operands
+    assert_eq(LongNum(1.5) * -4, LongNum(-6));
+    assert_eq(-4 * LongNum(1.5), LongNum(-6));
+    assert_eq(LongNum(-1.5) * 0, LongNum(0));
+    assert_eq((LongNum(-1.5) * 0).to_string(), std::string("0"));
+    x = LongNum(3).pow(500);
+    assert_eq(x * std::numeric_limits<uint64_t>::max(), x * LongNum(std::numeric_limits<uint64_t>::max()));
+    x = LongNum(0.75).with_precision(2);
+    x *= 3;
+    assert_eq(x, LongNum(2.25));
+    assert_eq(x.precision(), (unsigned int)DEFAULT_PRECISION);
+
+    // fused multiply-add and expression templates give the results of the plain operators
+    LongNum a = LongNum(3).pow(150) / 7;
+    LongNum b = -LongNum(5).pow(80).with_precision(200) / 3;
+    LongNum c = (LongNum(11) << 300).with_precision(0);
+    x = c;
+    x.add_product(a, b);
+    assert_eq(x, c + a * b);
+    assert_eq(x.precision(), 200u);
+    x.sub_product(a, b);
+    assert_eq(x, c + a * b - a * b);
+    x.add_product(b, -7);
+    assert_eq(x, c + a * b - a * b + b * -7);
+    x.sub_product(a, std::numeric_limits<uint64_t>::max());
+    assert_eq(x, c + a * b - a * b + b * -7 - a * std::numeric_limits<uint64_t>::max());
+    x = a;
+    x.add_product(x, x);
+    assert_eq(x, a + a * a);
+    y = a.lazy() * b + c;
+    assert_eq(y, a * b + c);
+    assert_eq(y.precision(), (a * b + c).precision());
+    y = c - 2 * a.lazy() + b.lazy() * 5 - a.lazy() * (b + 1) + -(c.lazy() * a);
+    assert_eq(y, c - 2 * a + b * 5 - a * (b + 1) + -(c * a));
+    y = (a.lazy() + b) * (c.lazy() - 1);
+    assert_eq(y, (a + b) * (c - 1));
+    y = c;
+    y += a.lazy() * b + b.lazy() * c - 3;
+    assert_eq(y, c + (a * b + b * c - 3));
+    y -= a.lazy() * b;
+    assert_eq(y, c + (a * b + b * c - 3) - a * b);
+    // terms reading the destination
+    y = a;
+    y += y.lazy() * b + y;
+    assert_eq(y, a + (a * b + a));
+    y = a;
+    y -= b.lazy() + y;
+    assert_eq(y, a - (b + a));
+    assert_eq(LongNum(LongNum(a).lazy() * b), a * b);
+    assert_eq(LongNum(a.lazy()), a);
+
+    // temporaries on either side give their limbs to the result
+    assert_eq((a + b) * (c - b), LongNum(a + b) * LongNum(c - b));
+    assert_eq(a * (b + c), (b + c) * a);
+    assert_eq(a + (b * c), (b * c) + a);
+    assert_eq(a - (b * c), -((b * c) - a));
+    assert_eq(-(a * b), -LongNum(a * b));
+    assert_eq((c * (a - b)).precision(), 200u);
+    y = a;
+    assert_eq(y - std::move(y), LongNum(0));
+    y = a;
+    assert_eq(y + std::move(y), a << 1);
+    y = a;
+    assert_eq(y * std::move(y), a * a);
+    x = b;
+    LongNum expected = b;
+    for (int i = 0; i < 5; i++) {
+        x *= a;
+        x *= b;
+        expected = LongNum(expected) * a;
+        expected = LongNum(expected) * b;
+        assert_eq(x, expected);
+    }
+    y = c;
+    x = y;
+    x *= x;
+    assert_eq(x, c * c);
+    assert_eq(y, c);
 }
 
 void test_longnum_division() {
@@ -391,7 +754,96 @@ void test_longnum_division() {
 
     assert_eq((LongNum(22) / 7).to_string().substr(0, 4), std::string("3.14"));
     assert_eq("5574748814014767969.4849916185514"_longdecimal / "25521421424.52151324364"_longdecimal, "1101000001010000101000110111.10110011001100011011111100100011100111001111"_longnum);
-    assert_eq("14767969.4849916153285514"_longdecimal / ".000513243642421412"_longdecimal, "11010110011000011010101010011110011.101111000011000000101000111000101100000100011"_longnum);
+    assert_eq("14767969.4849916153285514"_longdecimal / ".000513243642421412"_longdecimal, "11010110011000011010101010011110011.101111000011000000101000111000101100000100011011111000010001"_longnum);
+
+    // multi-limb divisors
+    for (unsigned int e : {10u, 50u, 200u, 1000u, 120000u}) {
+        LongNum x = LongNum(3).pow(e);
+        LongNum y = LongNum(7).pow(e / 2 + 1) + 1;
+        x.set_precision(0);
+        y.set_precision(0);
+        assert_eq((x * y) / y, x);
+        assert_eq(((x * y + 1) / y).truncate(), x);
+        assert_eq(((x * y - 1) / y).truncate(), x - 1);
+        assert_eq((-(x * y)) / y, -x);
+        assert_eq((x * y) / -x, -y);
+        assert_eq(y / (x * y), LongNum(0));
+    }
+    // divisor with a top limb of all ones and a remainder just below it, also long enough for the reciprocal
+    for (int bits : {192, 96000}) {
+        LongNum d = (LongNum(1) << bits) - 1;
+        d.set_precision(0);
+        LongNum q = (LongNum(1) << (bits * 4 / 3)) - 1;
+        q.set_precision(0);
+        LongNum n = d * q + (d - 1);
+        n.set_precision(0);
+        assert_eq(n / d, q);
+        assert_eq((n + 1) / d, q + 1);
+        assert_eq((n / (n + 1)).truncate(), LongNum(0));
+        assert_eq(n / n, LongNum(1));
+    }
+
+    // native integer divisors
+    LongNum third = LongNum(1).with_precision(300) / 3;
+    assert_eq(third, LongNum(1).with_precision(300) / LongNum(3));
+    assert_eq(third.precision(), 300u);
+    assert_eq(LongNum(1).with_precision(0) / 2, LongNum(0.5));
+    assert_eq((LongNum(1).with_precision(0) / 2).precision(), (unsigned int)DEFAULT_PRECISION);
+    assert_eq(LongNum(7) / -2, LongNum(-3.5));
+    assert_eq(LongNum(-7) / -2ll, LongNum(3.5));
+    assert_eq((LongNum(1) << 100) / std::numeric_limits<int64_t>::min(), -(LongNum(1) << 37));
+    assert_eq(((LongNum(1) << 128) - 1) / std::numeric_limits<uint64_t>::max(), (LongNum(1) << 64) + 1);
+    LongNum big = LongNum(3).pow(1000);
+    assert_eq(big * 7 / 7u, big);
+    thrown = false;
+    try {
+        LongNum(1) / 0u;
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    LongNum y = LongNum(1).with_precision(0);
+    assert_eq(y.divide_by(2), LongNum(0));
+    y = LongNum(1).with_precision(10);
+    assert_eq(y.divide_by(3).precision(), 10u);
+    assert_eq(y, "0.0101010101"_longnum);
+
+    y = -123.75;
+    assert_eq(y.divmod_small(10), (limb_t)3);
+    assert_eq(y, LongNum(-12));
+    assert_eq(y.divmod_small(100), (limb_t)12);
+    assert_eq(y, LongNum(0));
+    assert_eq(y.divmod_small(100), (limb_t)0);
+    y = big;
+    assert_eq(y.divmod_small(3), (limb_t)0);
+    assert_eq(y, LongNum(3).pow(999));
+
+    // precomputed divisors
+    LongNumDivisor small_divisor(LongNum(-7.25));
+    assert_eq(small_divisor.value(), LongNum(-7.25));
+    assert_eq(LongNum(29) / small_divisor, LongNum(29) / LongNum(-7.25));
+    assert_eq(big / small_divisor, big / LongNum(-7.25));
+    for (unsigned int e : {12000u, 40000u}) {
+        LongNum d = LongNum(7).pow(e) + 1;
+        LongNumDivisor divisor(d);
+        for (unsigned int f : {100u, 7000u, 30000u, 100000u}) {
+            LongNum x = LongNum(3).pow(f) - 5;
+            assert_eq(x / divisor, x / d);
+            assert_eq(-x / divisor, -x / d);
+            assert_eq((x * d) / divisor, x);
+            assert_eq((x * d - 1) / divisor, (x * d - 1) / d);
+            x.set_precision(3000);
+            assert_eq(x / divisor, x / d);
+        }
+    }
+    thrown = false;
+    try {
+        LongNumDivisor zero_divisor(0);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
 }
 
 void test_longnum_utils() {
@@ -441,6 +893,9 @@ void test_longnum_utils() {
     assert_eq(LongNum(123).pow(2), LongNum(15129));
     assert_eq(LongNum(123).pow(3), LongNum(1860867));
     assert_eq(LongNum(123).pow(10), "792594609605189126649"_longdecimal);
+    assert_eq(LongNum(-3).pow(3), LongNum(-27));
+    assert_eq((LongNum(1) << 1000).pow(100), LongNum(1) << 100000);
+    assert_eq(((LongNum(1) << 20) + 1).pow(2), (LongNum(1) << 40) + (LongNum(1) << 21) + 1);
 
     assert_eq(LongNum(123).to_int(), 123);
     assert_eq(LongNum(0).to_int(), 0);
@@ -452,4 +907,144 @@ void test_longnum_utils() {
     assert_eq(x.precision(), 123u);
     assert_eq(x.with_precision(0), x.truncate());
     assert_eq(x.with_precision(321).precision(), 321u); 
+
+    // values move between the inline limbs and the heap
+    LongNum small = LongNum(3) / 7;
+    LongNum grown = small;
+    grown <<= 1000;
+    LongNum moved = std::move(grown);
+    assert_eq(moved >> 1000, small);
+    moved >>= 1000;
+    assert_eq(moved, small);
+    small = moved << 500;
+    moved = std::move(small);
+    assert_eq(moved, (LongNum(3) / 7) << 500);
+
+    // copies share limbs until written, also when made from other threads
+    LongNum shared = LongNum(7).pow(2000);
+    LongNum copy = shared;
+    copy += 1;
+    assert_eq(copy - shared, LongNum(1));
+    copy = -shared;
+    assert_eq(copy + shared, LongNum(0));
+    std::vector<std::thread> threads;
+    std::atomic<int> correct = 0;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&shared, &correct, t] {
+            for (int i = 0; i < 100; i++) {
+                LongNum local = shared;
+                local *= t + 2;
+                if (local / (t + 2) == shared) {
+                    correct++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    assert_eq(correct.load(), 400);
+    assert_eq(shared, LongNum(7).pow(2000));
+
+    // kernel temporaries come from the scratch stack of the thread, which keeps its peak size until trimmed
+    LongNum wide = LongNum(3).pow(20000);
+    LongNum::trim_scratch();
+    assert_eq(LongNum::scratch_high_water(), 0u);
+    LongNum squared = wide * wide;
+    std::size_t peak = LongNum::scratch_high_water();
+    assert(peak > 0);
+    assert_eq(wide * wide, squared);
+    assert_eq(LongNum::scratch_high_water(), peak);
+    LongNum::trim_scratch();
+    assert_eq(LongNum::scratch_high_water(), 0u);
+    assert_eq(squared / wide, wide);
+    assert(LongNum::scratch_high_water() > 0);
+
+    // limbs come from the resource of the left operand, the arena has no upstream to fall back on
+    std::vector<std::byte> buffer(1 << 18);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    LongNum in_arena(LongNum(7).pow(300), &arena);
+    assert(in_arena.get_allocator().resource() == &arena);
+    for (const LongNum& value : {in_arena * in_arena + in_arena, in_arena / 3 - 1, in_arena.pow(3), -in_arena, LongNum(2, &arena) << 1000,
+                                 in_arena + (x << 1000), in_arena - (x << 1000), in_arena * (x << 1000)}) {
+        assert(value.get_allocator().resource() == &arena);
+    }
+    assert_eq((in_arena * in_arena) / in_arena, in_arena);
+    LongNum outside;
+    outside = in_arena;
+    assert(outside.get_allocator().resource() == std::pmr::get_default_resource());
+    assert_eq(outside, in_arena);
+    std::pmr::vector<LongNum> values(&arena);
+    values.push_back(outside);
+    values.emplace_back(3);
+    values.back() <<= 1000;
+    for (const LongNum& value : values) {
+        assert(value.get_allocator().resource() == &arena);
+    }
+    assert_eq(values[0], in_arena);
+    // the product buffer of the thread doesn't take the default resource, which may be gone before it
+    LongNum::trim_scratch();
+    {
+        std::vector<std::byte> scoped_buffer(1 << 16);
+        std::pmr::monotonic_buffer_resource scoped(scoped_buffer.data(), scoped_buffer.size(), std::pmr::null_memory_resource());
+        std::pmr::memory_resource* previous = std::pmr::set_default_resource(&scoped);
+        LongNum squared_in_scoped = LongNum(7).pow(300);
+        squared_in_scoped *= squared_in_scoped;
+        assert_eq(squared_in_scoped, LongNum(7).pow(600));
+        std::pmr::set_default_resource(previous);
+    }
+    LongNum squared_after = LongNum(7).pow(300);
+    squared_after *= squared_after;
+    assert_eq(squared_after, LongNum(7).pow(600));
+
+    // binary serialization keeps the exact representation
+    std::stringstream stream;
+    LongNum big = -LongNum(7).pow(5000) / 3;
+    for (const LongNum& value : {x, -x, LongNum(0), LongNum(0).with_precision(0), big}) {
+        stream.str("");
+        value.serialize(stream);
+        LongNum loaded = LongNum::deserialize(stream);
+        assert_eq(loaded, value);
+        assert_eq(loaded.precision(), value.precision());
+    }
+    stream.str("");
+    big.serialize(stream);
+    assert(LongNum::deserialize(stream, &arena).get_allocator().resource() == &arena);
+    // limbs grow geometrically when resized a few at a time, as deserialize does per block
+    LimbVector resized;
+    int reallocations = 0;
+    for (std::size_t n = 1; n <= 100000; n++) {
+        std::size_t capacity = resized.capacity();
+        resized.resize(n, n);
+        reallocations += resized.capacity() != capacity;
+    }
+    assert(reallocations < 20);
+    assert_eq(resized[99999], (limb_t)100000);
+    stream.str("LNUM");
+    bool thrown = false;
+    try {
+        LongNum::deserialize(stream);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "longnum-tests.lnum";
+    {
+        std::ofstream file(path, std::ios::binary);
+        big.serialize(file);
+    }
+    LongNumMapping mapping(path.string());
+    assert(mapping.negative());
+    assert_eq(mapping.precision(), big.precision());
+    assert_eq(mapping.magnitude().size(), 221u);
+    assert_eq(mapping.value(), big);
+    // the value borrows the mapped limbs, writing copies them and a value keeps the file mapped
+    LongNum borrowed = mapping.value(std::pmr::null_memory_resource());
+    LongNum written(borrowed, LongNum::allocator_type());
+    written += 1;
+    assert_eq(written - 1, big);
+    mapping = LongNumMapping(path.string());
+    assert_eq(borrowed, big);
+    std::filesystem::remove(path);
 }